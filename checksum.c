@@ -0,0 +1,291 @@
+/**
+ @file checksum.c
+ @brief CRC32 and CRC32C checksum callbacks with hardware accelerated paths selected at runtime
+*/
+#define ENET_BUILDING_LIB 1
+#include <string.h>
+#include "enet/enet.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define ENET_CHECKSUM_X86 1
+#define ENET_CHECKSUM_TARGET(features) __attribute__ ((target (features)))
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(_MSC_VER) && _MSC_VER >= 1600
+#define ENET_CHECKSUM_X86 1
+#define ENET_CHECKSUM_TARGET(features)
+#include <intrin.h>
+#endif
+#endif
+
+enum
+{
+    ENET_CRC32_POLYNOMIAL  = 0xEDB88320, /* reflected 0x04C11DB7 */
+    ENET_CRC32C_POLYNOMIAL = 0x82F63B78, /* reflected 0x1EDC6F41, Castagnoli */
+
+    ENET_CHECKSUM_FEATURE_SSE42  = (1 << 0),
+    ENET_CHECKSUM_FEATURE_PCLMUL = (1 << 1)
+};
+
+static int initializedChecksums = 0;
+static enet_uint32 checksumFeatures = 0;
+
+/* slicing-by-8 tables: table [k][byte] is the CRC of byte followed by k zero bytes */
+static enet_uint32 crc32Tables [8][256];
+static enet_uint32 crc32cTables [8][256];
+
+static void
+enet_checksum_initialize_tables (enet_uint32 tables [8][256], enet_uint32 polynomial)
+{
+    int byte, slice;
+
+    for (byte = 0; byte < 256; ++ byte)
+    {
+        enet_uint32 crc = byte;
+        int bit;
+
+        for (bit = 0; bit < 8; ++ bit)
+          crc = crc & 1 ? (crc >> 1) ^ polynomial : crc >> 1;
+
+        tables [0][byte] = crc;
+    }
+
+    for (slice = 1; slice < 8; ++ slice)
+    {
+        for (byte = 0; byte < 256; ++ byte)
+        {
+            enet_uint32 crc = tables [slice - 1][byte];
+
+            tables [slice][byte] = (crc >> 8) ^ tables [0][crc & 0xFF];
+        }
+    }
+}
+
+static enet_uint32
+enet_checksum_detect_features (void)
+{
+    enet_uint32 features = 0;
+#ifdef ENET_CHECKSUM_X86
+    unsigned int ecx;
+#ifdef _MSC_VER
+    int info [4];
+
+    __cpuid (info, 1);
+    ecx = (unsigned int) info [2];
+#else
+    unsigned int eax, ebx, edx;
+
+    if (! __get_cpuid (1, & eax, & ebx, & ecx, & edx))
+      return 0;
+#endif
+
+    if (ecx & (1 << 20))
+      features |= ENET_CHECKSUM_FEATURE_SSE42;
+
+    /* the final reduction extracts the result with an SSE4.1 instruction */
+    if ((ecx & (1 << 1)) && (ecx & (1 << 19)))
+      features |= ENET_CHECKSUM_FEATURE_PCLMUL;
+#endif
+    return features;
+}
+
+static void
+enet_checksum_initialize (void)
+{
+    enet_checksum_initialize_tables (crc32Tables, ENET_CRC32_POLYNOMIAL);
+    enet_checksum_initialize_tables (crc32cTables, ENET_CRC32C_POLYNOMIAL);
+
+    checksumFeatures = enet_checksum_detect_features ();
+
+    initializedChecksums = 1;
+}
+
+static enet_uint32
+enet_checksum_update_sliced (enet_uint32 tables [8][256], enet_uint32 crc, const enet_uint8 * data, size_t length)
+{
+    while (length >= 8)
+    {
+        crc ^= (enet_uint32) data [0] | ((enet_uint32) data [1] << 8) | ((enet_uint32) data [2] << 16) | ((enet_uint32) data [3] << 24);
+        crc = tables [7][crc & 0xFF] ^ tables [6][(crc >> 8) & 0xFF] ^ tables [5][(crc >> 16) & 0xFF] ^ tables [4][crc >> 24] ^
+              tables [3][data [4]] ^ tables [2][data [5]] ^ tables [1][data [6]] ^ tables [0][data [7]];
+
+        data += 8;
+        length -= 8;
+    }
+
+    while (length -- > 0)
+      crc = (crc >> 8) ^ tables [0][(crc ^ * data ++) & 0xFF];
+
+    return crc;
+}
+
+#ifdef ENET_CHECKSUM_X86
+/* Folds 64 bytes at a time into four 128 bit accumulators with carry-less multiplies, then
+   folds those into one and Barrett reduces it to 32 bits. The constants are x^(k) mod P for
+   the fold distances involved, bit reflected. Requires length >= 64 and a multiple of 16. */
+static ENET_CHECKSUM_TARGET ("pclmul,sse4.1") enet_uint32
+enet_crc32_update_pclmul (enet_uint32 crc, const enet_uint8 * data, size_t length)
+{
+    const __m128i fold4 = _mm_set_epi32 (0x00000001, 0xC6E41596, 0x00000001, 0x54442BD4),
+                  fold1 = _mm_set_epi32 (0x00000000, 0xCCAA009E, 0x00000001, 0x751997D0),
+                  fold64 = _mm_set_epi32 (0, 0, 0x00000001, 0x63CD6124),
+                  barrett = _mm_set_epi32 (0x00000001, 0xF7011641, 0x00000001, 0xDB710641),
+                  mask32 = _mm_setr_epi32 (~0, 0, ~0, 0);
+    __m128i x0, x1, x2, x3, x4;
+
+    x0 = _mm_xor_si128 (_mm_loadu_si128 ((const __m128i *) data), _mm_cvtsi32_si128 ((int) crc));
+    x1 = _mm_loadu_si128 ((const __m128i *) (data + 16));
+    x2 = _mm_loadu_si128 ((const __m128i *) (data + 32));
+    x3 = _mm_loadu_si128 ((const __m128i *) (data + 48));
+    data += 64;
+    length -= 64;
+
+    while (length >= 64)
+    {
+        x0 = _mm_xor_si128 (_mm_xor_si128 (_mm_clmulepi64_si128 (x0, fold4, 0x00), _mm_clmulepi64_si128 (x0, fold4, 0x11)),
+                            _mm_loadu_si128 ((const __m128i *) data));
+        x1 = _mm_xor_si128 (_mm_xor_si128 (_mm_clmulepi64_si128 (x1, fold4, 0x00), _mm_clmulepi64_si128 (x1, fold4, 0x11)),
+                            _mm_loadu_si128 ((const __m128i *) (data + 16)));
+        x2 = _mm_xor_si128 (_mm_xor_si128 (_mm_clmulepi64_si128 (x2, fold4, 0x00), _mm_clmulepi64_si128 (x2, fold4, 0x11)),
+                            _mm_loadu_si128 ((const __m128i *) (data + 32)));
+        x3 = _mm_xor_si128 (_mm_xor_si128 (_mm_clmulepi64_si128 (x3, fold4, 0x00), _mm_clmulepi64_si128 (x3, fold4, 0x11)),
+                            _mm_loadu_si128 ((const __m128i *) (data + 48)));
+        data += 64;
+        length -= 64;
+    }
+
+    x0 = _mm_xor_si128 (_mm_xor_si128 (_mm_clmulepi64_si128 (x0, fold1, 0x00), _mm_clmulepi64_si128 (x0, fold1, 0x11)), x1);
+    x0 = _mm_xor_si128 (_mm_xor_si128 (_mm_clmulepi64_si128 (x0, fold1, 0x00), _mm_clmulepi64_si128 (x0, fold1, 0x11)), x2);
+    x0 = _mm_xor_si128 (_mm_xor_si128 (_mm_clmulepi64_si128 (x0, fold1, 0x00), _mm_clmulepi64_si128 (x0, fold1, 0x11)), x3);
+
+    while (length >= 16)
+    {
+        x0 = _mm_xor_si128 (_mm_xor_si128 (_mm_clmulepi64_si128 (x0, fold1, 0x00), _mm_clmulepi64_si128 (x0, fold1, 0x11)),
+                            _mm_loadu_si128 ((const __m128i *) data));
+        data += 16;
+        length -= 16;
+    }
+
+    /* fold 128 bits down to 64 */
+    x0 = _mm_xor_si128 (_mm_srli_si128 (x0, 8), _mm_clmulepi64_si128 (x0, fold1, 0x10));
+    x0 = _mm_xor_si128 (_mm_srli_si128 (x0, 4), _mm_clmulepi64_si128 (_mm_and_si128 (x0, mask32), fold64, 0x00));
+
+    /* Barrett reduction to 32 bits */
+    x4 = _mm_clmulepi64_si128 (_mm_and_si128 (x0, mask32), barrett, 0x10);
+    x4 = _mm_clmulepi64_si128 (_mm_and_si128 (x4, mask32), barrett, 0x00);
+    x0 = _mm_xor_si128 (x0, x4);
+
+    return (enet_uint32) _mm_extract_epi32 (x0, 1);
+}
+
+static ENET_CHECKSUM_TARGET ("sse4.2") enet_uint32
+enet_crc32c_update_sse42 (enet_uint32 crc, const enet_uint8 * data, size_t length)
+{
+    for (; length > 0 && ((size_t) data & 7); -- length)
+      crc = _mm_crc32_u8 (crc, * data ++);
+
+#if defined(__x86_64__) || defined(_M_X64)
+    {
+        unsigned long long crc64 = crc, value;
+
+        for (; length >= 8; length -= 8, data += 8)
+        {
+            memcpy (& value, data, 8);
+            crc64 = _mm_crc32_u64 (crc64, value);
+        }
+
+        crc = (enet_uint32) crc64;
+    }
+#else
+    {
+        unsigned int value;
+
+        for (; length >= 4; length -= 4, data += 4)
+        {
+            memcpy (& value, data, 4);
+            crc = _mm_crc32_u32 (crc, value);
+        }
+    }
+#endif
+
+    for (; length > 0; -- length)
+      crc = _mm_crc32_u8 (crc, * data ++);
+
+    return crc;
+}
+#endif
+
+static enet_uint32
+enet_crc32_update (enet_uint32 crc, const enet_uint8 * data, size_t length)
+{
+#ifdef ENET_CHECKSUM_X86
+    if (length >= 64 && (checksumFeatures & ENET_CHECKSUM_FEATURE_PCLMUL))
+    {
+        size_t foldLength = length & ~ (size_t) 15;
+
+        crc = enet_crc32_update_pclmul (crc, data, foldLength);
+        data += foldLength;
+        length -= foldLength;
+    }
+#endif
+    return enet_checksum_update_sliced (crc32Tables, crc, data, length);
+}
+
+static enet_uint32
+enet_crc32c_update (enet_uint32 crc, const enet_uint8 * data, size_t length)
+{
+#ifdef ENET_CHECKSUM_X86
+    if (checksumFeatures & ENET_CHECKSUM_FEATURE_SSE42)
+      return enet_crc32c_update_sse42 (crc, data, length);
+#endif
+    return enet_checksum_update_sliced (crc32cTables, crc, data, length);
+}
+
+/** @defgroup Packet ENet packet functions
+    @{
+*/
+
+/** Computes the CRC32 (IEEE 802.3) of the data held in buffers[0:bufferCount-1] in network byte order.
+    May be set as ENetHost::checksum. Uses carry-less multiplication when the CPU supports it,
+    and slicing-by-8 tables otherwise; both produce the same checksum.
+*/
+enet_uint32
+enet_crc32 (const ENetBuffer * buffers, size_t bufferCount)
+{
+    enet_uint32 crc = 0xFFFFFFFF;
+
+    if (! initializedChecksums) enet_checksum_initialize ();
+
+    while (bufferCount -- > 0)
+    {
+        crc = enet_crc32_update (crc, (const enet_uint8 *) buffers -> data, buffers -> dataLength);
+
+        ++ buffers;
+    }
+
+    return ENET_HOST_TO_NET_32 (~ crc);
+}
+
+/** Computes the CRC32C (Castagnoli) of the data held in buffers[0:bufferCount-1] in network byte order.
+    May be set as ENetHost::checksum in place of enet_crc32, which is cheaper on CPUs with SSE4.2,
+    but both peers must use the same checksum callback.
+*/
+enet_uint32
+enet_crc32c (const ENetBuffer * buffers, size_t bufferCount)
+{
+    enet_uint32 crc = 0xFFFFFFFF;
+
+    if (! initializedChecksums) enet_checksum_initialize ();
+
+    while (bufferCount -- > 0)
+    {
+        crc = enet_crc32c_update (crc, (const enet_uint8 *) buffers -> data, buffers -> dataLength);
+
+        ++ buffers;
+    }
+
+    return ENET_HOST_TO_NET_32 (~ crc);
+}
+
+/** @} */
@@ -97,14 +97,26 @@ SOURCE=.\list.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\lz.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\callbacks.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\checksum.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\compress.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\group.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\packet.c
 # End Source File
 # Begin Source File
@@ -113,10 +125,22 @@ SOURCE=.\peer.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\pool.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\profile.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\protocol.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\table.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\unix.c
 # End Source File
 # Begin Source File
@@ -163,6 +187,14 @@ SOURCE=.\include\enet\utility.h
 
 SOURCE=.\include\enet\win32.h
 # End Source File
+# Begin Source File
+
+SOURCE=.\include\enet\internal\profile.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\enet\internal\trace.h
+# End Source File
 # End Group
 # End Target
 # End Project
@@ -0,0 +1,154 @@
+/**
+ @file  group.c
+ @brief ENet peer group functions
+*/
+#include <string.h>
+#define ENET_BUILDING_LIB 1
+#include "enet/enet.h"
+
+/** @defgroup group ENet peer group functions
+    @{
+*/
+
+/** Creates an empty group of peers belonging to a host.
+    @param host host whose peers may be added to the group
+    @returns the group on success, NULL on failure
+*/
+ENetPeerGroup *
+enet_group_create (ENetHost * host)
+{
+    ENetPeerGroup * group = (ENetPeerGroup *) enet_malloc (sizeof (ENetPeerGroup) + host -> peerCount * (sizeof (enet_uint32) + 2 * sizeof (enet_uint16)));
+    if (group == NULL)
+      return NULL;
+
+    group -> host = host;
+    group -> connectIDs = (enet_uint32 *) (group + 1);
+    group -> peers = (enet_uint16 *) (group -> connectIDs + host -> peerCount);
+    group -> positions = group -> peers + host -> peerCount;
+    group -> peerCount = 0;
+
+    memset (group -> positions, 0xFF, host -> peerCount * sizeof (enet_uint16));
+
+    return group;
+}
+
+/** Destroys a group. The peers in the group are not affected.
+    @param group group to destroy
+*/
+void
+enet_group_destroy (ENetPeerGroup * group)
+{
+    enet_free (group);
+}
+
+static void
+enet_group_remove_position (ENetPeerGroup * group, enet_uint16 position)
+{
+    enet_uint16 peerID = group -> peers [position],
+                lastPeerID = group -> peers [-- group -> peerCount];
+
+    group -> peers [position] = lastPeerID;
+    group -> connectIDs [position] = group -> connectIDs [group -> peerCount];
+    group -> positions [lastPeerID] = position;
+    group -> positions [peerID] = ENET_PEER_GROUP_NO_POSITION;
+}
+
+/** Adds a peer to a group.
+    @param group group to add the peer to
+    @param peer peer to add, which must belong to the group's host
+    @retval 0 on success or if the peer was already in the group
+    @retval < 0 on failure
+*/
+int
+enet_group_add (ENetPeerGroup * group, ENetPeer * peer)
+{
+    if (peer -> host != group -> host)
+      return -1;
+
+    /* a member whose peer was reset since is simply taken over by the peer's current connection */
+    if (group -> positions [peer -> incomingPeerID] != ENET_PEER_GROUP_NO_POSITION)
+    {
+       group -> connectIDs [group -> positions [peer -> incomingPeerID]] = peer -> connectID;
+
+       return 0;
+    }
+
+    group -> positions [peer -> incomingPeerID] = (enet_uint16) group -> peerCount;
+    group -> connectIDs [group -> peerCount] = peer -> connectID;
+    group -> peers [group -> peerCount ++] = peer -> incomingPeerID;
+
+    return 0;
+}
+
+/** Removes a peer from a group.
+    @param group group to remove the peer from
+    @param peer peer to remove
+    @retval 0 on success
+    @retval < 0 if the peer was not in the group
+*/
+int
+enet_group_remove (ENetPeerGroup * group, ENetPeer * peer)
+{
+    enet_uint16 position;
+    int result;
+
+    if (peer -> host != group -> host ||
+        group -> positions [peer -> incomingPeerID] == ENET_PEER_GROUP_NO_POSITION)
+      return -1;
+
+    position = group -> positions [peer -> incomingPeerID];
+
+    /* a member left over from an earlier connection of the peer is dropped all the same */
+    result = group -> connectIDs [position] == peer -> connectID ? 0 : -1;
+
+    enet_group_remove_position (group, position);
+
+    return result;
+}
+
+/** Queues a packet to be sent to all connected peers in a group. Members whose peers were reset
+    since they were added are dropped from the group.
+    @param group group on which to broadcast the packet
+    @param channelID channel on which to broadcast
+    @param packet packet to broadcast
+*/
+void
+enet_group_broadcast (ENetPeerGroup * group, enet_uint8 channelID, ENetPacket * packet)
+{
+    ENetHost * host = group -> host;
+    enet_uint32 mtu = 0;
+    size_t fragmentLength = 0, peerIndex;
+
+    if (packet -> dataLength <= host -> maximumPacketSize)
+    {
+       /* members are visited from the back so that dropping one moves an already visited member into its place */
+       for (peerIndex = group -> peerCount; peerIndex > 0; )
+       {
+          ENetPeer * currentPeer = & host -> peers [group -> peers [-- peerIndex]];
+
+          if (currentPeer -> connectID != group -> connectIDs [peerIndex])
+          {
+             enet_group_remove_position (group, (enet_uint16) peerIndex);
+
+             continue;
+          }
+
+          if (currentPeer -> state != ENET_PEER_STATE_CONNECTED ||
+              channelID >= currentPeer -> channelCount)
+            continue;
+
+          if (currentPeer -> mtu != mtu)
+          {
+             mtu = currentPeer -> mtu;
+             fragmentLength = enet_peer_fragment_length (currentPeer);
+          }
+
+          enet_peer_queue_packet (currentPeer, channelID, packet, fragmentLength);
+       }
+    }
+
+    if (packet -> referenceCount == 0)
+      enet_packet_destroy (packet);
+}
+
+/** @} */
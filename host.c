@@ -10,6 +10,20 @@
     @{
 */
 
+static void
+enet_host_destroy_pools (ENetHost * host)
+{
+    enet_packet_pool_destroy (host -> packetPool);
+    enet_object_pool_destroy (& host -> outgoingCommandPool);
+    enet_object_pool_destroy (& host -> incomingCommandPool);
+    enet_object_pool_destroy (& host -> acknowledgementPool);
+
+    if (host -> commands != NULL)
+      enet_free (host -> commands);
+    if (host -> buffers != NULL)
+      enet_free (host -> buffers);
+}
+
 /** Creates a host for communicating to peers.
 
     @param address   the address at which other peers may connect to this host.  If NULL, then no peers may connect to the host.
@@ -30,6 +44,7 @@ enet_host_create (const ENetAddress * address, int isHost, size_t peerCount, siz
 {
     ENetHost * host;
     ENetPeer * currentPeer;
+    size_t priority;
 
     if (peerCount > ENET_PROTOCOL_MAXIMUM_PEER_ID || NULL == address)
       return NULL;
@@ -48,6 +63,22 @@ enet_host_create (const ENetAddress * address, int isHost, size_t peerCount, siz
     }
     memset (host -> peers, 0, peerCount * sizeof (ENetPeer));
 
+    host -> mtu = ENET_HOST_DEFAULT_MTU;
+
+    host -> packetPool = enet_packet_pool_create ();
+    if (host -> packetPool == NULL ||
+        enet_object_pool_initialize (& host -> outgoingCommandPool, sizeof (ENetOutgoingCommand), peerCount * ENET_HOST_POOL_OBJECTS_PER_PEER) < 0 ||
+        enet_object_pool_initialize (& host -> incomingCommandPool, sizeof (ENetIncomingCommand), peerCount * ENET_HOST_POOL_OBJECTS_PER_PEER) < 0 ||
+        enet_object_pool_initialize (& host -> acknowledgementPool, sizeof (ENetAcknowledgement), peerCount * ENET_HOST_POOL_OBJECTS_PER_PEER) < 0 ||
+        enet_host_command_limit (host, 0) < 0)
+    {
+       enet_host_destroy_pools (host);
+       enet_free (host -> peers);
+       enet_free (host);
+
+       return NULL;
+    }
+
 	enet_uint16 family = address->family;
 
     host -> socket = enet_socket_create (ENET_SOCKET_TYPE_DATAGRAM, family);
@@ -62,6 +93,7 @@ enet_host_create (const ENetAddress * address, int isHost, size_t peerCount, siz
        if (host -> socket != ENET_SOCKET_NULL)
          enet_socket_destroy (host -> socket);
 
+       enet_host_destroy_pools (host);
        enet_free (host -> peers);
        enet_free (host);
 
@@ -94,7 +126,6 @@ enet_host_create (const ENetAddress * address, int isHost, size_t peerCount, siz
     host -> outgoingBandwidth = outgoingBandwidth;
     host -> bandwidthThrottleEpoch = 0;
     host -> recalculateBandwidthLimits = 0;
-    host -> mtu = ENET_HOST_DEFAULT_MTU;
     host -> peerCount = peerCount;
     host -> commandCount = 0;
     host -> bufferCount = 0;
@@ -112,6 +143,11 @@ enet_host_create (const ENetAddress * address, int isHost, size_t peerCount, siz
     host -> totalSentPackets = 0;
     host -> totalReceivedData = 0;
     host -> totalReceivedPackets = 0;
+    host -> totalCompressedPackets = 0;
+    host -> totalCompressionFailures = 0;
+    host -> totalCompressionSkippedByFlag = 0;
+    host -> totalCompressionSkippedByEntropy = 0;
+    host -> totalCompressionSkippedByRatio = 0;
 
     host -> connectedPeers = 0;
     host -> bandwidthLimitedPeers = 0;
@@ -123,10 +159,21 @@ enet_host_create (const ENetAddress * address, int isHost, size_t peerCount, siz
     host -> compressor.compress = NULL;
     host -> compressor.decompress = NULL;
     host -> compressor.destroy = NULL;
+    host -> adaptiveCompression = 0;
+    host -> protocolFeatures = 0;
+    memset (& host -> dictionaryCompressor, 0, sizeof (host -> dictionaryCompressor));
+    host -> dictionaryHash = 0;
+    host -> coalesceLimit = 0;
+    host -> coalesceDelay = 0;
+    host -> profileFlags = 0;
+    host -> profileHistograms = NULL;
 
     host -> intercept = NULL;
+    host -> receive = NULL;
+    host -> receiveFailed = 0;
 
-    enet_list_clear (& host -> dispatchQueue);
+    for (priority = 0; priority < ENET_PEER_DISPATCH_PRIORITIES; ++ priority)
+      enet_list_clear (& host -> dispatchQueues [priority]);
 
     for (currentPeer = host -> peers;
          currentPeer < & host -> peers [host -> peerCount];
@@ -142,8 +189,14 @@ enet_host_create (const ENetAddress * address, int isHost, size_t peerCount, siz
        enet_list_clear (& currentPeer -> sentUnreliableCommands);
        enet_list_clear (& currentPeer -> outgoingReliableCommands);
        enet_list_clear (& currentPeer -> outgoingUnreliableCommands);
+
        enet_list_clear (& currentPeer -> dispatchedCommands);
 
+       for (priority = 0; priority < ENET_PEER_CHANNEL_PRIORITIES; ++ priority)
+         enet_list_clear (& currentPeer -> sendQueues [priority]);
+
+       currentPeer -> sentReliableTable = NULL;
+
        enet_peer_reset (currentPeer);
     }
 
@@ -172,6 +225,13 @@ enet_host_destroy (ENetHost * host)
 
     if (host -> compressor.context != NULL && host -> compressor.destroy)
       (* host -> compressor.destroy) (host -> compressor.context);
+    if (host -> dictionaryCompressor.context != NULL && host -> dictionaryCompressor.destroy)
+      (* host -> dictionaryCompressor.destroy) (host -> dictionaryCompressor.context);
+
+    enet_host_destroy_pools (host);
+
+    if (host -> profileHistograms != NULL)
+      enet_free (host -> profileHistograms);
 
     enet_free (host -> peers);
     enet_free (host);
@@ -192,6 +252,7 @@ enet_host_connect (ENetHost * host, const ENetAddress * address, size_t channelC
     ENetPeer * currentPeer;
     ENetChannel * channel;
     ENetProtocol command;
+    ENetPacket * extension;
 
     if (channelCount < ENET_PROTOCOL_MINIMUM_CHANNEL_COUNT)
       channelCount = ENET_PROTOCOL_MINIMUM_CHANNEL_COUNT;
@@ -217,6 +278,7 @@ enet_host_connect (ENetHost * host, const ENetAddress * address, size_t channelC
     currentPeer -> state = ENET_PEER_STATE_CONNECTING;
     currentPeer -> address = * address;
     currentPeer -> connectID = ++ host -> randomSeed;
+    memset (& currentPeer -> stats, 0, sizeof (currentPeer -> stats));
 
     if (host -> outgoingBandwidth == 0)
       currentPeer -> windowSize = ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE;
@@ -242,9 +304,24 @@ enet_host_connect (ENetHost * host, const ENetAddress * address, size_t channelC
 
         enet_list_clear (& channel -> incomingReliableCommands);
         enet_list_clear (& channel -> incomingUnreliableCommands);
+        enet_list_clear (& channel -> outgoingReliableCommands);
+        enet_list_clear (& channel -> outgoingUnreliableCommands);
+
+        channel -> needsSend = 0;
+        channel -> sendPriority = ENET_PEER_CHANNEL_PRIORITY;
+        channel -> sendWeight = ENET_PEER_CHANNEL_WEIGHT;
+        channel -> sendDeficit = 0;
 
         channel -> usedReliableWindows = 0;
         memset (channel -> reliableWindows, 0, sizeof (channel -> reliableWindows));
+
+        channel -> outgoingStream = NULL;
+        channel -> incomingStream = NULL;
+        channel -> incomingReliableTable = NULL;
+        channel -> sentReliableTable = NULL;
+        channel -> outgoingSlotTable = NULL;
+        channel -> coalescedPacket = NULL;
+        channel -> coalescedTime = 0;
     }
 
     command.header.command = ENET_PROTOCOL_COMMAND_CONNECT | ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE;
@@ -263,12 +340,18 @@ enet_host_connect (ENetHost * host, const ENetAddress * address, size_t channelC
     command.connect.connectID = currentPeer -> connectID;
     command.connect.data = ENET_HOST_TO_NET_32 (data);
 
-    enet_peer_queue_outgoing_command (currentPeer, & command, NULL, 0, 0);
+    extension = enet_protocol_create_extension (host, host -> protocolFeatures);
+
+    if (enet_peer_queue_outgoing_command (currentPeer, & command, extension, 0, extension != NULL ? extension -> dataLength : 0) == NULL &&
+        extension != NULL)
+      enet_packet_destroy (extension);
 
     return currentPeer;
 }
 
 /** Queues a packet to be sent to all peers associated with the host.
+    The packet is shared by every recipient and its fragmentation is only
+    recomputed when the MTU differs from that of the previous recipient.
     @param host host on which to broadcast the packet
     @param channelID channel on which to broadcast
     @param packet packet to broadcast
@@ -277,15 +360,27 @@ void
 enet_host_broadcast (ENetHost * host, enet_uint8 channelID, ENetPacket * packet)
 {
     ENetPeer * currentPeer;
+    enet_uint32 mtu = 0;
+    size_t fragmentLength = 0;
 
-    for (currentPeer = host -> peers;
-         currentPeer < & host -> peers [host -> peerCount];
-         ++ currentPeer)
+    if (packet -> dataLength <= host -> maximumPacketSize)
     {
-       if (currentPeer -> state != ENET_PEER_STATE_CONNECTED)
-         continue;
+       for (currentPeer = host -> peers;
+            currentPeer < & host -> peers [host -> peerCount];
+            ++ currentPeer)
+       {
+          if (currentPeer -> state != ENET_PEER_STATE_CONNECTED ||
+              channelID >= currentPeer -> channelCount)
+            continue;
 
-       enet_peer_send (currentPeer, channelID, packet);
+          if (currentPeer -> mtu != mtu)
+          {
+             mtu = currentPeer -> mtu;
+             fragmentLength = enet_peer_fragment_length (currentPeer);
+          }
+
+          enet_peer_queue_packet (currentPeer, channelID, packet, fragmentLength);
+       }
     }
 
     if (packet -> referenceCount == 0)
@@ -308,6 +403,33 @@ enet_host_compress (ENetHost * host, const ENetCompressor * compressor)
       host -> compressor.context = NULL;
 }
 
+/** Enables coalescing of small packets sent to peers into aggregate commands that carry each
+    packet behind a length prefix of one or two bytes and are unpacked again on receipt, so that
+    chatty peers fill datagrams with fewer, larger commands.
+
+    Packets of at most a quarter of the aggregate size without a deadline are coalesced with the
+    packets sent before them on the same channel. An aggregate is queued once the next packet does
+    not fit in it, once a packet sent another way (reliably, unreliably, unsequenced or without
+    compression) or a packet that is not coalesced is sent on its channel, once delay milliseconds
+    have passed since its first packet was added, or when enet_host_flush() is called.
+    @param host host to enable coalescing for
+    @param size largest aggregate in bytes, further limited to what fits in a single command to each peer; 0 disables coalescing
+    @param delay longest time in milliseconds a packet waits for others to be coalesced with it
+    @remarks coalescing is negotiated when connecting, so it only applies to peers that connect
+    afterwards and that have enabled it too
+*/
+void
+enet_host_coalesce (ENetHost * host, size_t size, enet_uint32 delay)
+{
+    host -> coalesceLimit = size;
+    host -> coalesceDelay = delay;
+
+    if (size > 0)
+      host -> protocolFeatures |= ENET_PROTOCOL_FEATURE_COALESCING;
+    else
+      host -> protocolFeatures &= ~ ENET_PROTOCOL_FEATURE_COALESCING;
+}
+
 /** Limits the maximum allowed channels of future incoming connections.
     @param host host to limit
     @param channelLimit the maximum number of channels allowed; if 0, then this is equivalent to ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT
@@ -325,6 +447,79 @@ enet_host_channel_limit (ENetHost * host, size_t channelLimit)
 }
 
 
+/** Limits the number of commands packed into a single datagram, resizing the arrays the host
+    assembles its outgoing datagrams in.
+    @param host host to limit
+    @param commandLimit the maximum number of commands per datagram; if 0, then as many acknowledgements as fit in the host's MTU
+    @retval 0 on success
+    @retval < 0 on failure, in which case the previous limit is kept
+    @remarks the limit is capped at ENET_PROTOCOL_MAXIMUM_PACKET_COMMANDS and at the number of bare
+    command headers that fit in the host's MTU, so it should be set again after changing the MTU.
+    It must not be called from within a callback invoked while the host is sending.
+*/
+int
+enet_host_command_limit (ENetHost * host, size_t commandLimit)
+{
+    size_t mtuLimit = (host -> mtu - sizeof (ENetProtocolHeader)) / sizeof (ENetProtocolCommandHeader),
+           bufferLimit;
+    ENetProtocol * commands;
+    ENetBuffer * buffers;
+
+    if (! commandLimit)
+      commandLimit = (host -> mtu - sizeof (ENetProtocolHeader)) / sizeof (ENetProtocolAcknowledge);
+    if (commandLimit > mtuLimit)
+      commandLimit = mtuLimit;
+    if (commandLimit > ENET_PROTOCOL_MAXIMUM_PACKET_COMMANDS)
+      commandLimit = ENET_PROTOCOL_MAXIMUM_PACKET_COMMANDS;
+    if (commandLimit < 1)
+      commandLimit = 1;
+
+    /* besides the header, each command takes a buffer and usually one more for its data, but a
+       gather packet may need a buffer per segment, and one always has to fit in an empty datagram */
+    bufferLimit = 1 + 2 * commandLimit;
+    if (bufferLimit < commandLimit + ENET_PACKET_GATHER_MAXIMUM + 1)
+      bufferLimit = commandLimit + ENET_PACKET_GATHER_MAXIMUM + 1;
+    if (bufferLimit > ENET_BUFFER_MAXIMUM)
+      bufferLimit = ENET_BUFFER_MAXIMUM;
+
+    if (commandLimit == host -> commandLimit && bufferLimit == host -> bufferLimit)
+      return 0;
+
+    commands = (ENetProtocol *) enet_malloc (commandLimit * sizeof (ENetProtocol));
+    if (commands == NULL)
+      return -1;
+
+    buffers = (ENetBuffer *) enet_malloc (bufferLimit * sizeof (ENetBuffer));
+    if (buffers == NULL)
+    {
+       enet_free (commands);
+
+       return -1;
+    }
+
+    if (host -> commands != NULL)
+      enet_free (host -> commands);
+    if (host -> buffers != NULL)
+      enet_free (host -> buffers);
+
+    host -> commands = commands;
+    host -> commandLimit = commandLimit;
+    host -> buffers = buffers;
+    host -> bufferLimit = bufferLimit;
+
+    return 0;
+}
+
+/** Retrieves the statistics of a host.
+    @param host host to query
+    @param stats receives the statistics
+*/
+void
+enet_host_get_stats (const ENetHost * host, ENetStats * stats)
+{
+    * stats = host -> stats;
+}
+
 /** Adjusts the bandwidth limits of a host.
     @param host host to adjust
     @param incomingBandwidth new incoming bandwidth
@@ -207,6 +207,13 @@ typedef enum _ENetPacketFlag
    /** packet will be fragmented using unreliable (instead of reliable) sends
      * if it exceeds the MTU */
    ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT = (1 << 3),
+   /** datagrams mostly made up of this packet's data will not be compressed, nor will
+     * the packet be stream compressed, for data that is already compressed or otherwise
+     * incompressible */
+   ENET_PACKET_FLAG_NO_COMPRESS = (1 << 4),
+   /** packet has a deadline set with enet_packet_set_deadline, after which unreliable
+     * sends of it are dropped instead of sent */
+   ENET_PACKET_FLAG_DEADLINE = (1 << 5),
 
    /** whether the packet has been sent from all queues it has been entered into */
    ENET_PACKET_FLAG_SENT = (1<<8)
@@ -234,6 +241,12 @@ typedef void (ENET_CALLBACK * ENetPacketFreeCallback) (struct _ENetPacket *);
  *    ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT - packet will be fragmented using unreliable
  *    (instead of reliable) sends if it exceeds the MTU
  *
+ *    ENET_PACKET_FLAG_NO_COMPRESS - datagrams mostly made up of this packet's data will
+ *    not be compressed, nor will the packet be stream compressed
+ *
+ *    ENET_PACKET_FLAG_DEADLINE - unreliable sends of the packet still queued after its
+ *    deadline are dropped, set by enet_packet_set_deadline
+ *
  *    ENET_PACKET_FLAG_SENT - whether the packet has been sent from all queues it has been entered into
    @sa ENetPacketFlag
  */
@@ -245,8 +258,62 @@ typedef struct _ENetPacket
    size_t                   dataLength;      /**< length of data */
    ENetPacketFreeCallback   freeCallback;    /**< function to be called when the packet is no longer in use */
    void *                   userData;        /**< application private data, may be freely modified */
+   struct _ENetPacketPool * pool;            /**< internal use only */
+   size_t                   capacity;        /**< internal use only */
+   struct _ENetPacket **    segments;        /**< packets the data is gathered from, or NULL if the data is contiguous */
+   size_t                   segmentCount;    /**< number of segments */
+   enet_uint32              deadline;        /**< time after which unreliable sends of the packet are dropped, if ENET_PACKET_FLAG_DEADLINE is set */
 } ENetPacket;
 
+enum
+{
+   ENET_PACKET_POOL_SIZE_CLASSES    = 6,
+   ENET_PACKET_POOL_MINIMUM_SIZE    = 64,
+   ENET_PACKET_POOL_MAXIMUM_SIZE    = ENET_PACKET_POOL_MINIMUM_SIZE << (ENET_PACKET_POOL_SIZE_CLASSES - 1),
+   ENET_PACKET_POOL_MAXIMUM_FREE    = 256,
+
+   ENET_PACKET_MAXIMUM_SEGMENTS     = 16
+};
+
+/**
+ * Per-host cache of packet blocks that hold the packet and its data in a single
+ * allocation. The pool outlives its host for as long as packets allocated from it
+ * remain in use.
+ */
+typedef struct _ENetPacketPool
+{
+   size_t                   referenceCount;
+   int                      closed;
+   ENetPacket *             freePackets [ENET_PACKET_POOL_SIZE_CLASSES];
+   size_t                   freeCount [ENET_PACKET_POOL_SIZE_CLASSES];
+} ENetPacketPool;
+
+enum
+{
+   ENET_OBJECT_POOL_MINIMUM_CHUNK_SIZE = 64
+};
+
+/**
+ * Pool of fixed-size objects, grown in chunks and never shrunk until destroyed.
+ * The hits and misses fields count allocations served from the free list and
+ * allocations that found it empty, respectively, and may be read or reset by the user.
+ */
+typedef struct _ENetObjectPool
+{
+   size_t                   objectSize;
+   size_t                   chunkSize;
+   void *                   freeObjects;
+   void *                   chunks;
+   size_t                   objectCount;     /**< number of objects allocated by the pool */
+   enet_uint32              hits;            /**< allocations served without growing the pool */
+   enet_uint32              misses;          /**< allocations that had to grow the pool */
+} ENetObjectPool;
+
+/**
+ * Table of entries indexed by 16 bit sequence number, allocated in blocks as entries are added.
+ */
+typedef struct _ENetSequenceTable ENetSequenceTable;
+
 typedef struct _ENetAcknowledgement
 {
    ENetListNode acknowledgementList;
@@ -265,6 +332,10 @@ typedef struct _ENetOutgoingCommand
    enet_uint32  fragmentOffset;
    enet_uint16  fragmentLength;
    enet_uint16  sendAttempts;
+   enet_uint16  inTransit;          /**< whether the command is on sentReliableCommands rather than queued for resending */
+   enet_uint16  slot;               /**< slot the command was sent to with enet_peer_send_slot() */
+   enet_uint16  slotted;            /**< whether the command is the unsent latest value of its slot */
+   enet_uint32  fragmentsRemaining;
    ENetProtocol command;
    ENetPacket * packet;
 } ENetOutgoingCommand;
@@ -299,6 +370,11 @@ typedef enum _ENetPeerState
 #define ENET_BUFFER_MAXIMUM (1 + 2 * ENET_PROTOCOL_MAXIMUM_PACKET_COMMANDS)
 #endif
 
+/* a gather packet is sent as a buffer per segment following the buffers of its command and of
+   the datagram header, so platforms with few buffers per datagram allow fewer segments */
+#define ENET_PACKET_GATHER_MAXIMUM \
+   (ENET_BUFFER_MAXIMUM - 2 < ENET_PACKET_MAXIMUM_SEGMENTS ? ENET_BUFFER_MAXIMUM - 2 : ENET_PACKET_MAXIMUM_SEGMENTS)
+
 enum
 {
    ENET_HOST_RECEIVE_BUFFER_SIZE          = 256 * 1024,
@@ -307,6 +383,13 @@ enum
    ENET_HOST_DEFAULT_MTU                  = 1400,
    ENET_HOST_DEFAULT_MAXIMUM_PACKET_SIZE  = 32 * 1024 * 1024,
    ENET_HOST_DEFAULT_MAXIMUM_WAITING_DATA = 32 * 1024 * 1024,
+   ENET_HOST_POOL_OBJECTS_PER_PEER        = 4,
+   ENET_HOST_COMPRESSION_SAMPLE_MINIMUM   = 256,
+   ENET_HOST_COMPRESSION_SAMPLE_MAXIMUM   = 512,
+   ENET_HOST_COMPRESSION_ENTROPY_LIMIT    = 7 * 256,
+   ENET_LZ_DICTIONARY_MAXIMUM             = 32 * 1024,
+   ENET_LZ_STREAM_WINDOW_SIZE             = 16 * 1024,
+   ENET_LZ_STREAM_MAXIMUM_PACKET_SIZE     = 16 * 1024,
 
    ENET_PEER_DEFAULT_ROUND_TRIP_TIME      = 500,
    ENET_PEER_DEFAULT_PACKET_THROTTLE      = 32,
@@ -327,11 +410,26 @@ enum
    ENET_PEER_FREE_UNSEQUENCED_WINDOWS     = 32,
    ENET_PEER_RELIABLE_WINDOWS             = 16,
    ENET_PEER_RELIABLE_WINDOW_SIZE         = 0x1000,
-   ENET_PEER_FREE_RELIABLE_WINDOWS        = 8
+   ENET_PEER_FREE_RELIABLE_WINDOWS        = 8,
+   ENET_PEER_COMPRESSION_RATIO_SCALE      = 256,
+   ENET_PEER_COMPRESSION_RATIO_LIMIT      = 243,
+   ENET_PEER_COMPRESSION_BACKOFF_MINIMUM  = 16,
+   ENET_PEER_COMPRESSION_BACKOFF_MAXIMUM  = 1024,
+   ENET_PEER_DISPATCH_PRIORITIES          = 4,
+   ENET_PEER_DISPATCH_PRIORITY            = 1,
+   ENET_PEER_DISPATCH_QUANTUM             = 4096,
+   ENET_PEER_CHANNEL_PRIORITIES           = 4,
+   ENET_PEER_CHANNEL_PRIORITY             = 1,
+   ENET_PEER_CHANNEL_WEIGHT               = 1,
+   ENET_PEER_CHANNEL_WEIGHT_MAXIMUM       = 0xFFFF,
+   ENET_PEER_COALESCE_MAXIMUM_PACKETS     = 128
 };
 
+typedef struct _ENetLZStream ENetLZStream;
+
 typedef struct _ENetChannel
 {
+   ENetListNode sendList;
    enet_uint16  outgoingReliableSequenceNumber;
    enet_uint16  outgoingUnreliableSequenceNumber;
    enet_uint16  usedReliableWindows;
@@ -340,8 +438,90 @@ typedef struct _ENetChannel
    enet_uint16  incomingUnreliableSequenceNumber;
    ENetList     incomingReliableCommands;
    ENetList     incomingUnreliableCommands;
+   ENetList     outgoingReliableCommands;
+   ENetList     outgoingUnreliableCommands;
+   int          needsSend;
+   enet_uint32  sendPriority;             /**< priority class the channel is sent in, lower classes fill datagrams first */
+   enet_uint32  sendWeight;               /**< share of the datagrams the channel gets within its class, in units of the peer MTU per turn */
+   enet_uint32  sendDeficit;
+   ENetSequenceTable * incomingReliableTable; /**< reliable commands waiting on incomingReliableCommands indexed by sequence number, allocated on first use */
+   ENetSequenceTable * sentReliableTable;     /**< reliable commands sent on the channel and not yet acknowledged indexed by sequence number, allocated on first use */
+   ENetSequenceTable * outgoingSlotTable;     /**< commands queued with enet_peer_send_slot() and not yet transmitted indexed by slot, allocated on first use */
+   ENetLZStream * outgoingStream;   /**< compression history of reliable packets sent on the channel, allocated on first use */
+   ENetLZStream * incomingStream;   /**< decompression history of reliable packets received on the channel, allocated on first use */
+   ENetPacket * coalescedPacket;    /**< aggregate of small packets waiting to be queued as one command, see enet_host_coalesce() */
+   enet_uint32  coalescedTime;      /**< time the first packet was added to coalescedPacket */
 } ENetChannel;
 
+/**
+ * Phases of servicing a host that are timed when it is profiled, see enet_host_profile().
+ *
+ * Some phases happen within others: decoding includes decompressing and verifying
+ * the checksums of received datagrams, and packing includes checking for timeouts.
+ */
+typedef enum _ENetProfilePhase
+{
+   ENET_PROFILE_PHASE_RECEIVE  = 0,   /**< receiving a datagram from the socket */
+   ENET_PROFILE_PHASE_DECODE   = 1,   /**< handling the commands of a received datagram */
+   ENET_PROFILE_PHASE_DISPATCH = 2,   /**< finding the next event to dispatch */
+   ENET_PROFILE_PHASE_TIMEOUTS = 3,   /**< checking the sent reliable commands of a peer for timeouts */
+   ENET_PROFILE_PHASE_PACK     = 4,   /**< packing the outgoing commands of a peer into a datagram */
+   ENET_PROFILE_PHASE_COMPRESS = 5,   /**< compressing or decompressing a datagram */
+   ENET_PROFILE_PHASE_CHECKSUM = 6,   /**< computing the checksum of a datagram */
+   ENET_PROFILE_PHASE_SEND     = 7,   /**< sending a datagram on the socket */
+   ENET_PROFILE_PHASE_COUNT    = 8
+} ENetProfilePhase;
+
+typedef enum _ENetHostProfileFlag
+{
+   ENET_HOST_PROFILE_PHASES = (1 << 0),   /**< record a histogram of the time taken by each phase */
+   ENET_HOST_PROFILE_PEERS  = (1 << 1)    /**< add the time taken on behalf of each peer to ENetStats::cycles */
+} ENetHostProfileFlag;
+
+enum
+{
+   ENET_PROFILE_HISTOGRAM_BUCKETS = 40
+};
+
+/**
+ * Histogram of the time taken by a phase of servicing a host, see enet_host_get_profile().
+ *
+ * Times are in ticks of the processor's cycle counter, or in nanoseconds where the
+ * library does not know how to read one.
+ */
+typedef struct _ENetProfileHistogram
+{
+   enet_uint64   samples;                /**< number of times the phase was timed */
+   enet_uint64   cycles;                 /**< total time taken by the phase */
+   enet_uint64   maximum;                /**< longest time the phase took */
+   enet_uint64   buckets [ENET_PROFILE_HISTOGRAM_BUCKETS]; /**< samples by the bit length of their time, so bucket n > 0 counts times from 2^(n-1) up to 2^n, and the last bucket all longer ones */
+} ENetProfileHistogram;
+
+/**
+ * Statistics of a peer or a host, see enet_peer_get_stats() and enet_host_get_stats().
+ *
+ * The counters only ever increase, a peer's from the start of its current or last connection
+ * and a host's from its creation. A host's counters cover all connections it has had, as well
+ * as datagrams and commands it did not accept from any peer.
+ */
+typedef struct _ENetStats
+{
+   enet_uint64   sentData;               /**< bytes sent in datagrams, including protocol headers */
+   enet_uint64   sentDatagrams;          /**< UDP packets sent */
+   enet_uint64   receivedData;           /**< bytes received in datagrams, including protocol headers */
+   enet_uint64   receivedDatagrams;      /**< UDP packets received */
+   enet_uint64   sentCommands [ENET_PROTOCOL_COMMAND_COUNT];     /**< commands sent, indexed by ENetProtocolCommand and including retransmissions */
+   enet_uint64   receivedCommands [ENET_PROTOCOL_COMMAND_COUNT]; /**< commands received, indexed by ENetProtocolCommand */
+   enet_uint64   retransmittedCommands;  /**< reliable commands queued to be sent again because their acknowledgement timed out */
+   enet_uint64   duplicateCommands;      /**< received commands dropped because they had already been received */
+   enet_uint64   outOfOrderCommands;     /**< received commands that arrived ahead of or behind their place in the sequence of their channel */
+   enet_uint64   throttleDrops;          /**< unreliable packets dropped by the packet throttle */
+   enet_uint64   windowStalls;           /**< times sending reliable commands was held back by a full send or reliable window */
+   enet_uint64   compressionSavings;     /**< bytes saved by compressing datagrams before sending them */
+   enet_uint64   checksumFailures;       /**< received datagrams dropped because their checksum did not match */
+   enet_uint64   cycles;                 /**< time spent on behalf of the peer, or of all peers for a host, in the units of ENetProfileHistogram, if enabled with enet_host_profile() */
+} ENetStats;
+
 /**
  * An ENet peer which data packets may be sent or received from.
  *
@@ -374,6 +554,7 @@ typedef struct _ENetPeer
    enet_uint32   packetLossEpoch;
    enet_uint32   packetsSent;
    enet_uint32   packetsLost;
+   enet_uint32   packetsExpired;      /**< unreliable packets dropped because their deadline passed before they could be sent */
    enet_uint32   packetLoss;          /**< mean packet loss of reliable packets as a ratio with respect to the constant ENET_PEER_PACKET_LOSS_SCALE */
    enet_uint32   packetLossVariance;
    enet_uint32   packetThrottle;
@@ -399,16 +580,27 @@ typedef struct _ENetPeer
    enet_uint16   outgoingReliableSequenceNumber;
    ENetList      acknowledgements;
    ENetList      sentReliableCommands;
+   ENetSequenceTable * sentReliableTable;     /**< reliable commands sent outside of any channel and not yet acknowledged indexed by sequence number */
    ENetList      sentUnreliableCommands;
-   ENetList      outgoingReliableCommands;
-   ENetList      outgoingUnreliableCommands;
+   ENetList      outgoingReliableCommands;    /**< reliable commands queued outside of any channel, sent ahead of all channels */
+   ENetList      outgoingUnreliableCommands;  /**< unreliable commands queued outside of any channel, sent ahead of all channels */
+   ENetList      sendQueues [ENET_PEER_CHANNEL_PRIORITIES]; /**< channels with queued outgoing commands, one queue per priority class */
    ENetList      dispatchedCommands;
    int           needsDispatch;
+   enet_uint32   dispatchPriority;            /**< priority class the peer is dispatched in, lower classes are served first */
+   enet_uint32   dispatchQuantum;             /**< bytes of received packets the peer may dispatch each turn within its class */
+   enet_uint32   dispatchDeficit;
    enet_uint16   incomingUnsequencedGroup;
    enet_uint16   outgoingUnsequencedGroup;
    enet_uint32   unsequencedWindow [ENET_PEER_UNSEQUENCED_WINDOW_SIZE / 32];
    enet_uint32   eventData;
    size_t        totalWaitingData;
+   enet_uint32   compressionRatio;            /**< moving average of compressed size over original size, in units of 1/ENET_PEER_COMPRESSION_RATIO_SCALE */
+   enet_uint32   compressionBackoff;
+   enet_uint32   compressionSkip;
+   enet_uint32   protocolFeatures;            /**< ENET_PROTOCOL_FEATURE_* flags both ends of the connection agreed on */
+   size_t        coalescedChannels;           /**< number of channels holding an aggregate of coalesced packets */
+   ENetStats     stats;                       /**< statistics of the connection, read with enet_peer_get_stats() */
 } ENetPeer;
 
 /** An ENet packet compressor for compressing UDP packets before socket sends or receives.
@@ -431,6 +623,9 @@ typedef enet_uint32 (ENET_CALLBACK * ENetChecksumCallback) (const ENetBuffer * b
 /** Callback for intercepting received raw UDP packets. Should return 1 to intercept, 0 to ignore, or -1 to propagate an error. */
 typedef int (ENET_CALLBACK * ENetInterceptCallback) (struct _ENetHost * host, struct _ENetEvent * event);
 
+/** Callback for consuming unsequenced and unreliable packets directly from the receive buffer. The data is only valid for the duration of the call. Should return 0 if the data was consumed, 1 to retain it as an ENetPacket delivered by enet_host_service(), or -1 to propagate an error from enet_host_service(), discarding the rest of the datagram. */
+typedef int (ENET_CALLBACK * ENetReceiveCallback) (struct _ENetHost * host, ENetPeer * peer, enet_uint8 channelID, const enet_uint8 * data, size_t dataLength, enet_uint32 flags);
+
 /** An ENet host for communicating with peers.
   *
   * No fields should be modified unless otherwise stated.
@@ -443,9 +638,14 @@ typedef int (ENET_CALLBACK * ENetInterceptCallback) (struct _ENetHost * host, st
     @sa enet_host_broadcast()
     @sa enet_host_compress()
     @sa enet_host_compress_with_range_coder()
+    @sa enet_host_compress_with_fast_lz()
     @sa enet_host_channel_limit()
+    @sa enet_host_command_limit()
     @sa enet_host_bandwidth_limit()
     @sa enet_host_bandwidth_throttle()
+    @sa enet_host_get_stats()
+    @sa enet_host_profile()
+    @sa enet_host_packet_create()
   */
 typedef struct _ENetHost
 {
@@ -461,25 +661,48 @@ typedef struct _ENetHost
    size_t               peerCount;                   /**< number of peers allocated for this host */
    size_t               channelLimit;                /**< maximum number of channels allowed for connected peers */
    enet_uint32          serviceTime;
-   ENetList             dispatchQueue;
+   ENetList             dispatchQueues [ENET_PEER_DISPATCH_PRIORITIES];
    int                  continueSending;
    size_t               packetSize;
+   size_t               incompressibleSize;
    enet_uint16          headerFlags;
-   ENetProtocol         commands [ENET_PROTOCOL_MAXIMUM_PACKET_COMMANDS];
+   ENetProtocol *       commands;
    size_t               commandCount;
-   ENetBuffer           buffers [ENET_BUFFER_MAXIMUM];
+   size_t               commandLimit;                /**< maximum number of commands packed into a single datagram, see enet_host_command_limit() */
+   ENetBuffer *         buffers;
    size_t               bufferCount;
+   size_t               bufferLimit;
    ENetChecksumCallback checksum;                    /**< callback the user can set to enable packet checksums for this host */
    ENetCompressor       compressor;
+   int                  adaptiveCompression;         /**< if set, skip compressing datagrams that look incompressible or have not been compressing well for the peer */
+   enet_uint32          protocolFeatures;            /**< optional ENET_PROTOCOL_FEATURE_* flags to offer to peers when connecting, defaults to 0 */
+   ENetCompressor       dictionaryCompressor;        /**< compressor used instead of compressor for peers that agreed on the dictionary */
+   enet_uint32          dictionaryHash;              /**< hash identifying the dictionary set with enet_host_dictionary(), 0 if none */
+   size_t               coalesceLimit;               /**< largest aggregate small packets are coalesced into, 0 if coalescing is disabled, see enet_host_coalesce() */
+   enet_uint32          coalesceDelay;               /**< longest time in milliseconds a coalesced packet waits for others */
    enet_uint8           packetData [2][ENET_PROTOCOL_MAXIMUM_MTU];
    ENetAddress          receivedAddress;
    enet_uint8 *         receivedData;
    size_t               receivedDataLength;
+   ENetStats            stats;                       /**< statistics of the host, read with enet_host_get_stats() */
+   enet_uint32          profileFlags;                /**< ENET_HOST_PROFILE_* flags set with enet_host_profile() */
+   ENetProfileHistogram * profileHistograms;         /**< histogram of each ENetProfilePhase, allocated while phases are profiled */
    enet_uint32          totalSentData;               /**< total data sent, user should reset to 0 as needed to prevent overflow */
    enet_uint32          totalSentPackets;            /**< total UDP packets sent, user should reset to 0 as needed to prevent overflow */
    enet_uint32          totalReceivedData;           /**< total data received, user should reset to 0 as needed to prevent overflow */
    enet_uint32          totalReceivedPackets;        /**< total UDP packets received, user should reset to 0 as needed to prevent overflow */
+   enet_uint32          totalCompressedPackets;      /**< total UDP packets sent compressed, user should reset to 0 as needed to prevent overflow */
+   enet_uint32          totalCompressionFailures;    /**< total UDP packets the compressor failed to shrink, user should reset to 0 as needed to prevent overflow */
+   enet_uint32          totalCompressionSkippedByFlag;    /**< total UDP packets not compressed because of ENET_PACKET_FLAG_NO_COMPRESS */
+   enet_uint32          totalCompressionSkippedByEntropy; /**< total UDP packets not compressed because their estimated entropy was too high */
+   enet_uint32          totalCompressionSkippedByRatio;   /**< total UDP packets not compressed because compression was not paying off for the peer */
    ENetInterceptCallback intercept;                  /**< callback the user can set to intercept received raw UDP packets */
+   ENetReceiveCallback  receive;                     /**< callback the user can set to consume unsequenced and unreliable packets without copying them */
+   int                  receiveFailed;
+   ENetPacketPool *     packetPool;
+   ENetObjectPool       outgoingCommandPool;         /**< pool of outgoing commands for all peers of the host */
+   ENetObjectPool       incomingCommandPool;         /**< pool of incoming commands for all peers of the host */
+   ENetObjectPool       acknowledgementPool;         /**< pool of acknowledgements for all peers of the host */
    size_t               connectedPeers;
    size_t               bandwidthLimitedPeers;
    size_t               duplicatePeers;              /**< optional number of allowed peers from duplicate IPs, defaults to ENET_PROTOCOL_MAXIMUM_PEER_ID */
@@ -487,6 +710,34 @@ typedef struct _ENetHost
    size_t               maximumWaitingData;          /**< the maximum aggregate amount of buffer space a peer may use waiting for packets to be delivered */
 } ENetHost;
 
+enum
+{
+   ENET_PEER_GROUP_NO_POSITION = 0xFFFF
+};
+
+/**
+ * A set of peers of a host that packets may be broadcast to.
+ *
+ * Members are kept as a dense array of peer indices with a per-peer position
+ * table, so adding and removing peers take constant time. Peers that are not
+ * connected remain members but are skipped by enet_group_broadcast(). Membership
+ * belongs to a connection: once a member's peer is reset, for instance to be
+ * reused for another connection, it is no longer in the group.
+   @sa enet_group_create()
+   @sa enet_group_destroy()
+   @sa enet_group_add()
+   @sa enet_group_remove()
+   @sa enet_group_broadcast()
+ */
+typedef struct _ENetPeerGroup
+{
+   ENetHost *    host;
+   enet_uint32 * connectIDs;    /**< connectID of each member when it was added, to tell whether its peer was since reset */
+   enet_uint16 * peers;         /**< indices into the host's peers of the members of the group */
+   enet_uint16 * positions;     /**< position of each of the host's peers in the peers array, or ENET_PEER_GROUP_NO_POSITION */
+   size_t        peerCount;     /**< number of peers in the group */
+} ENetPeerGroup;
+
 /**
  * An ENet event type, as specified in @ref ENetEvent.
  */
@@ -647,7 +898,14 @@ ENET_API int enet_address_get_host (const ENetAddress * address, char * hostName
 ENET_API ENetPacket * enet_packet_create (const void *, size_t, enet_uint32);
 ENET_API void         enet_packet_destroy (ENetPacket *);
 ENET_API int          enet_packet_resize  (ENetPacket *, size_t);
+ENET_API void         enet_packet_set_deadline (ENetPacket *, enet_uint32);
+ENET_API ENetPacket * enet_packet_create_gather (ENetPacket * const *, size_t, enet_uint32);
+extern size_t         enet_packet_gather_count (const ENetPacket *, size_t, size_t);
+extern size_t         enet_packet_gather (const ENetPacket *, size_t, size_t, ENetBuffer *);
 ENET_API enet_uint32  enet_crc32 (const ENetBuffer *, size_t);
+ENET_API enet_uint32  enet_crc32c (const ENetBuffer *, size_t);
+extern ENetPacketPool * enet_packet_pool_create (void);
+extern void             enet_packet_pool_destroy (ENetPacketPool *);
 
 ENET_API ENetHost * enet_host_create (const ENetAddress *, int, size_t, size_t, enet_uint32, enet_uint32);
 ENET_API void       enet_host_destroy (ENetHost *);
@@ -658,12 +916,21 @@ ENET_API void       enet_host_flush (ENetHost *);
 ENET_API void       enet_host_broadcast (ENetHost *, enet_uint8, ENetPacket *);
 ENET_API void       enet_host_compress (ENetHost *, const ENetCompressor *);
 ENET_API int        enet_host_compress_with_range_coder (ENetHost * host);
+ENET_API int        enet_host_compress_with_fast_lz (ENetHost * host, const void * dictionary, size_t dictionaryLength);
+ENET_API int        enet_host_dictionary (ENetHost * host, const void * dictionary, size_t dictionaryLength);
+ENET_API void       enet_host_coalesce (ENetHost *, size_t, enet_uint32);
 ENET_API void       enet_host_channel_limit (ENetHost *, size_t);
+ENET_API int        enet_host_command_limit (ENetHost *, size_t);
 ENET_API void       enet_host_bandwidth_limit (ENetHost *, enet_uint32, enet_uint32);
+ENET_API void       enet_host_get_stats (const ENetHost *, ENetStats *);
+ENET_API int        enet_host_profile (ENetHost *, enet_uint32);
+ENET_API int        enet_host_get_profile (const ENetHost *, ENetProfilePhase, ENetProfileHistogram *);
+ENET_API ENetPacket * enet_host_packet_create (ENetHost *, const void *, size_t, enet_uint32);
 extern   void       enet_host_bandwidth_throttle (ENetHost *);
 extern  enet_uint32 enet_host_random_seed (void);
 
 ENET_API int                 enet_peer_send (ENetPeer *, enet_uint8, ENetPacket *);
+ENET_API int                 enet_peer_send_slot (ENetPeer *, enet_uint8, enet_uint16, ENetPacket *);
 ENET_API ENetPacket *        enet_peer_receive (ENetPeer *, enet_uint8 * channelID);
 ENET_API void                enet_peer_ping (ENetPeer *);
 ENET_API void                enet_peer_ping_interval (ENetPeer *, enet_uint32);
@@ -673,23 +940,67 @@ ENET_API void                enet_peer_disconnect (ENetPeer *, enet_uint32);
 ENET_API void                enet_peer_disconnect_now (ENetPeer *, enet_uint32);
 ENET_API void                enet_peer_disconnect_later (ENetPeer *, enet_uint32);
 ENET_API void                enet_peer_throttle_configure (ENetPeer *, enet_uint32, enet_uint32, enet_uint32);
+ENET_API void                enet_peer_dispatch_configure (ENetPeer *, enet_uint32, enet_uint32);
+ENET_API int                 enet_peer_channel_configure (ENetPeer *, enet_uint8, enet_uint32, enet_uint32);
+ENET_API void                enet_peer_get_stats (const ENetPeer *, ENetStats *);
 extern int                   enet_peer_throttle (ENetPeer *, enet_uint32);
 extern void                  enet_peer_reset_queues (ENetPeer *);
+extern size_t                enet_peer_fragment_length (ENetPeer *);
+extern int                   enet_peer_queue_packet (ENetPeer *, enet_uint8, ENetPacket *, size_t);
 extern void                  enet_peer_setup_outgoing_command (ENetPeer *, ENetOutgoingCommand *);
+extern void                  enet_peer_clear_slot (ENetPeer *, ENetOutgoingCommand *);
 extern ENetOutgoingCommand * enet_peer_queue_outgoing_command (ENetPeer *, const ENetProtocol *, ENetPacket *, enet_uint32, enet_uint16);
+extern ENetOutgoingCommand * enet_peer_split_outgoing_fragment (ENetPeer *, ENetOutgoingCommand *);
 extern ENetIncomingCommand * enet_peer_queue_incoming_command (ENetPeer *, const ENetProtocol *, const void *, size_t, enet_uint32, enet_uint32);
 extern ENetAcknowledgement * enet_peer_queue_acknowledgement (ENetPeer *, const ENetProtocol *, enet_uint16);
 extern void                  enet_peer_dispatch_incoming_unreliable_commands (ENetPeer *, ENetChannel *);
-extern void                  enet_peer_dispatch_incoming_reliable_commands (ENetPeer *, ENetChannel *);
+extern void                  enet_peer_dispatch_incoming_reliable_commands (ENetPeer *, ENetChannel *, ENetIncomingCommand *);
+extern ENetIncomingCommand * enet_peer_find_incoming_reliable_command (ENetChannel *, enet_uint16);
+extern void                  enet_peer_queue_dispatch (ENetPeer *);
+extern void                  enet_peer_queue_channel (ENetPeer *, ENetChannel *);
+extern int                   enet_peer_has_outgoing_commands (ENetPeer *);
+extern void                  enet_peer_flush_coalesced_packets (ENetPeer *, enet_uint32);
 extern void                  enet_peer_on_connect (ENetPeer *);
 extern void                  enet_peer_on_disconnect (ENetPeer *);
 
+ENET_API ENetPeerGroup *     enet_group_create (ENetHost *);
+ENET_API void                enet_group_destroy (ENetPeerGroup *);
+ENET_API int                 enet_group_add (ENetPeerGroup *, ENetPeer *);
+ENET_API int                 enet_group_remove (ENetPeerGroup *, ENetPeer *);
+ENET_API void                enet_group_broadcast (ENetPeerGroup *, enet_uint8, ENetPacket *);
+
 ENET_API void * enet_range_coder_create (void);
 ENET_API void   enet_range_coder_destroy (void *);
 ENET_API size_t enet_range_coder_compress (void *, const ENetBuffer *, size_t, size_t, enet_uint8 *, size_t);
 ENET_API size_t enet_range_coder_decompress (void *, const enet_uint8 *, size_t, enet_uint8 *, size_t);
 
+ENET_API void * enet_lz_create (const void *, size_t);
+ENET_API void   enet_lz_destroy (void *);
+ENET_API size_t enet_lz_compress (void *, const ENetBuffer *, size_t, size_t, enet_uint8 *, size_t);
+ENET_API size_t enet_lz_decompress (void *, const enet_uint8 *, size_t, enet_uint8 *, size_t);
+ENET_API size_t enet_lz_train_dictionary (const ENetBuffer *, size_t, void *, size_t);
+extern ENetLZStream *     enet_lz_stream_create (int);
+extern void               enet_lz_stream_destroy (ENetLZStream *);
+extern size_t             enet_lz_stream_compress (ENetLZStream *, const enet_uint8 *, size_t, enet_uint8 *, size_t);
+extern const enet_uint8 * enet_lz_stream_decompress (ENetLZStream *, const enet_uint8 *, size_t, size_t);
+extern void               enet_lz_stream_commit (ENetLZStream *, size_t);
+
 extern size_t enet_protocol_command_size (enet_uint8);
+extern ENetPacket * enet_protocol_create_extension (ENetHost *, enet_uint32);
+extern size_t enet_protocol_write_varint (enet_uint8 *, enet_uint32);
+extern int    enet_protocol_read_varint (const enet_uint8 **, const enet_uint8 *, enet_uint32 *);
+
+extern int    enet_object_pool_initialize (ENetObjectPool *, size_t, size_t);
+extern void   enet_object_pool_destroy (ENetObjectPool *);
+extern void * enet_object_pool_allocate (ENetObjectPool *);
+extern void   enet_object_pool_free (ENetObjectPool *, void *);
+
+extern void * enet_sequence_table_find (const ENetSequenceTable *, enet_uint16);
+extern int    enet_sequence_table_reserve (ENetSequenceTable **, enet_uint16);
+extern void   enet_sequence_table_insert (ENetSequenceTable *, enet_uint16, void *);
+extern void   enet_sequence_table_remove (ENetSequenceTable *, enet_uint16);
+extern size_t enet_sequence_table_size (const ENetSequenceTable *);
+extern void   enet_sequence_table_destroy (ENetSequenceTable *);
 
 #ifdef __cplusplus
 }
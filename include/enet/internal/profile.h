@@ -0,0 +1,27 @@
+/** 
+ @file  internal/profile.h
+ @brief ENet service profiling macros, not installed
+*/
+#ifndef __ENET_INTERNAL_PROFILE_H__
+#define __ENET_INTERNAL_PROFILE_H__
+
+#include "enet/enet.h"
+
+#ifdef ENET_PROFILE
+
+extern enet_uint64 enet_profile_cycles (void);
+extern void        enet_profile_stop (ENetHost *, ENetProfilePhase, ENetPeer *, enet_uint64);
+
+#define ENET_PROFILE_START(host, start) ((start) = (host) -> profileFlags ? enet_profile_cycles () : 0)
+#define ENET_PROFILE_STOP(host, phase, peer, start) \
+    do { if ((host) -> profileFlags) enet_profile_stop (host, phase, peer, start); } while (0)
+
+#else
+
+#define ENET_PROFILE_START(host, start) ((start) = 0)
+#define ENET_PROFILE_STOP(host, phase, peer, start) ((void) (start))
+
+#endif
+
+#endif /* __ENET_INTERNAL_PROFILE_H__ */
+
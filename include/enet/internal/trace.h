@@ -0,0 +1,44 @@
+/** 
+ @file  internal/trace.h
+ @brief ENet static tracepoint macros, not installed
+*/
+#ifndef __ENET_INTERNAL_TRACE_H__
+#define __ENET_INTERNAL_TRACE_H__
+
+/* Builds with ENET_TRACE defined place USDT probes of the provider "enet" on the protocol's
+   hot paths, to be attached to with perf, bpftrace or SystemTap. An unattached probe is a
+   single nop, so the only cost is keeping its arguments at hand. The probes and their
+   arguments are:
+
+   datagram-receive   (host, length)
+   datagram-send      (host, peer, length)
+   command-queue      (peer, command, channelID, reliableSequenceNumber, length)
+   command-send       (peer, command, channelID, reliableSequenceNumber, sendAttempts)
+   command-acknowledge (peer, command, channelID, reliableSequenceNumber, roundTripTime)
+   command-retransmit (peer, command, channelID, reliableSequenceNumber, roundTripTimeout)
+   fragment-reassemble (peer, channelID, startSequenceNumber, fragmentCount, totalLength)
+   peer-state         (peer, previousState, state)
+   peer-throttle      (peer, packetThrottle, roundTripTime)
+   peer-timeout       (peer, reliableSequenceNumber, roundTripTimeout)
+
+   Commands are ENetProtocolCommand numbers, 0 for an acknowledgement that matched no sent
+   command, and peer states are ENetPeerState values. */
+
+#ifdef ENET_TRACE
+
+#include <sys/sdt.h>
+
+#define ENET_PROBE2(name, a, b) DTRACE_PROBE2 (enet, name, a, b)
+#define ENET_PROBE3(name, a, b, c) DTRACE_PROBE3 (enet, name, a, b, c)
+#define ENET_PROBE5(name, a, b, c, d, e) DTRACE_PROBE5 (enet, name, a, b, c, d, e)
+
+#else
+
+#define ENET_PROBE2(name, a, b) ((void) 0)
+#define ENET_PROBE3(name, a, b, c) ((void) 0)
+#define ENET_PROBE5(name, a, b, c, d, e) ((void) 0)
+
+#endif
+
+#endif /* __ENET_INTERNAL_TRACE_H__ */
+
@@ -11,7 +11,7 @@ enum
 {
    ENET_PROTOCOL_MINIMUM_MTU             = 576,
    ENET_PROTOCOL_MAXIMUM_MTU             = 4096,
-   ENET_PROTOCOL_MAXIMUM_PACKET_COMMANDS = 32,
+   ENET_PROTOCOL_MAXIMUM_PACKET_COMMANDS = 256,
    ENET_PROTOCOL_MINIMUM_WINDOW_SIZE     = 4096,
    ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE     = 65536,
    ENET_PROTOCOL_MINIMUM_CHANNEL_COUNT   = 1,
@@ -36,6 +36,8 @@ typedef enum _ENetProtocolCommand
    ENET_PROTOCOL_COMMAND_THROTTLE_CONFIGURE = 11,
    ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE_FRAGMENT = 12,
    ENET_PROTOCOL_COMMAND_COUNT              = 13,
+   /** not a command: marks a datagram whose commands use the compact encoding */
+   ENET_PROTOCOL_COMMAND_COMPACT            = 15,
 
    ENET_PROTOCOL_COMMAND_MASK               = 0x0F
 } ENetProtocolCommand;
@@ -44,6 +46,8 @@ typedef enum _ENetProtocolFlag
 {
    ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE = (1 << 7),
    ENET_PROTOCOL_COMMAND_FLAG_UNSEQUENCED = (1 << 6),
+   ENET_PROTOCOL_COMMAND_FLAG_COMPRESSED  = (1 << 5),
+   ENET_PROTOCOL_COMMAND_FLAG_AGGREGATE   = (1 << 4),
 
    ENET_PROTOCOL_HEADER_FLAG_COMPRESSED = (1 << 14),
    ENET_PROTOCOL_HEADER_FLAG_SENT_TIME  = (1 << 15),
@@ -53,6 +57,27 @@ typedef enum _ENetProtocolFlag
    ENET_PROTOCOL_HEADER_SESSION_SHIFT   = 12
 } ENetProtocolFlag;
 
+/** Optional protocol features negotiated by the extension that may follow the
+    connect and verify connect commands. Peers that do not understand the extension
+    stop parsing the datagram at its header and so never enable any of these.
+*/
+typedef enum _ENetProtocolFeature
+{
+   /** reliable packets may be compressed against the history of their channel */
+   ENET_PROTOCOL_FEATURE_STREAM_COMPRESSION = (1 << 0),
+   /** datagrams may be compressed with a pre-shared dictionary, only agreed on if
+       the dictionary hashes of both ends match */
+   ENET_PROTOCOL_FEATURE_DICTIONARY         = (1 << 1),
+   /** small packets may be coalesced into aggregate commands that carry each of them
+       behind a length prefix */
+   ENET_PROTOCOL_FEATURE_COALESCING         = (1 << 2),
+   /** datagrams may carry their commands in a compact encoding with variable length
+       fields, marked by ENET_PROTOCOL_COMMAND_COMPACT in place of the first command */
+   ENET_PROTOCOL_FEATURE_COMPACT_COMMANDS   = (1 << 3),
+
+   ENET_PROTOCOL_EXTENSION_MAGIC = 0x4558
+} ENetProtocolFeature;
+
 #ifdef _MSC_VER
 #pragma pack(push, 1)
 #define ENET_PACKED
@@ -174,6 +199,19 @@ typedef struct _ENetProtocolSendFragment
    enet_uint32 fragmentOffset;
 } ENET_PACKED ENetProtocolSendFragment;
 
+/** Trails a connect or verify connect command in the same datagram. The header
+    carries ENET_PROTOCOL_COMMAND_NONE with the channel ID 0xFF and the reliable sequence
+    number ENET_PROTOCOL_EXTENSION_MAGIC, and dataLength covers the whole extension so
+    that fields may be appended later.
+*/
+typedef struct _ENetProtocolExtension
+{
+   ENetProtocolCommandHeader header;
+   enet_uint16 dataLength;
+   enet_uint32 features;
+   enet_uint32 dictionaryHash;
+} ENET_PACKED ENetProtocolExtension;
+
 typedef union _ENetProtocol
 {
    ENetProtocolCommandHeader header;
@@ -8,6 +8,11 @@
 typedef unsigned char enet_uint8;       /**< unsigned 8-bit type  */
 typedef unsigned short enet_uint16;     /**< unsigned 16-bit type */
 typedef unsigned int enet_uint32;      /**< unsigned 32-bit type */
+#ifdef _MSC_VER
+typedef unsigned __int64 enet_uint64;  /**< unsigned 64-bit type */
+#else
+typedef unsigned long long enet_uint64; /**< unsigned 64-bit type */
+#endif
 
 #endif /* __ENET_TYPES_H__ */
 
@@ -0,0 +1,741 @@
+/**
+ @file lz.c
+ @brief A fast byte-oriented LZ compressor with an optional pre-shared dictionary or per-channel history,
+        and a trainer for such dictionaries
+*/
+#define ENET_BUILDING_LIB 1
+#include <stdlib.h>
+#include <string.h>
+#include "enet/enet.h"
+
+/* Each sequence is a token byte holding the literal run length in its high nibble and the
+   match length minus ENET_LZ_MINIMUM_MATCH in its low nibble, with a nibble of 15 continued
+   by bytes of 255 terminated by a smaller byte. The literals follow the token, then a
+   2 byte little-endian match offset and the match length continuation. The final sequence
+   holds only literals and ends at the end of the input. Match offsets may reach back past
+   the start of the data into the dictionary, which behaves as if it preceded the data. */
+enum
+{
+    ENET_LZ_MINIMUM_MATCH = 4,
+    ENET_LZ_MAXIMUM_OFFSET = 0xFFFF,
+
+    ENET_LZ_HASH_BITS = 10,
+    ENET_LZ_HASH_SIZE = 1 << ENET_LZ_HASH_BITS,
+    ENET_LZ_DICTIONARY_HASH_BITS = 14,
+    ENET_LZ_DICTIONARY_HASH_SIZE = 1 << ENET_LZ_DICTIONARY_HASH_BITS
+};
+
+typedef struct _ENetLZ
+{
+    /* the dictionary immediately followed by room for the data being compressed */
+    enet_uint8 * window;
+    size_t dictionaryLength;
+    /* positions + 1 of the last occurrence of each hashed sequence, 0 if none */
+    enet_uint16 hashTable [ENET_LZ_HASH_SIZE];
+    enet_uint16 dictionaryHashTable [ENET_LZ_DICTIONARY_HASH_SIZE];
+} ENetLZ;
+
+#define ENET_LZ_READ_32(data) \
+    ((enet_uint32) (data) [0] | ((enet_uint32) (data) [1] << 8) | ((enet_uint32) (data) [2] << 16) | ((enet_uint32) (data) [3] << 24))
+
+#define ENET_LZ_HASH(value, bits) (((value) * 2654435761U) >> (32 - (bits)))
+
+/** Creates a context for the LZ compressor.
+    @param dictionary data both ends of the connection will treat as preceding every packet, or NULL
+    @param dictionaryLength length of the dictionary, at most ENET_LZ_DICTIONARY_MAXIMUM bytes
+    @returns the context on success, NULL on failure
+*/
+void *
+enet_lz_create (const void * dictionary, size_t dictionaryLength)
+{
+    ENetLZ * lz;
+    size_t position;
+
+    if (dictionaryLength > ENET_LZ_DICTIONARY_MAXIMUM || (dictionary == NULL && dictionaryLength > 0))
+      return NULL;
+
+    lz = (ENetLZ *) enet_malloc (sizeof (ENetLZ));
+    if (lz == NULL)
+      return NULL;
+
+    lz -> window = (enet_uint8 *) enet_malloc (dictionaryLength + ENET_PROTOCOL_MAXIMUM_MTU);
+    if (lz -> window == NULL)
+    {
+       enet_free (lz);
+
+       return NULL;
+    }
+
+    lz -> dictionaryLength = dictionaryLength;
+    if (dictionaryLength > 0)
+      memcpy (lz -> window, dictionary, dictionaryLength);
+
+    memset (lz -> dictionaryHashTable, 0, sizeof (lz -> dictionaryHashTable));
+
+    for (position = 0; position + ENET_LZ_MINIMUM_MATCH <= dictionaryLength; ++ position)
+    {
+       enet_uint32 value = ENET_LZ_READ_32 (& lz -> window [position]);
+
+       lz -> dictionaryHashTable [ENET_LZ_HASH (value, ENET_LZ_DICTIONARY_HASH_BITS)] = (enet_uint16) (position + 1);
+    }
+
+    return lz;
+}
+
+void
+enet_lz_destroy (void * context)
+{
+    ENetLZ * lz = (ENetLZ *) context;
+    if (lz == NULL)
+      return;
+
+    enet_free (lz -> window);
+    enet_free (lz);
+}
+
+static enet_uint8 *
+enet_lz_write_length (enet_uint8 * outData, const enet_uint8 * outEnd, size_t length)
+{
+    for (; length >= 255; length -= 255)
+    {
+       if (outData >= outEnd)
+         return NULL;
+       * outData ++ = 255;
+    }
+
+    if (outData >= outEnd)
+      return NULL;
+    * outData ++ = (enet_uint8) length;
+
+    return outData;
+}
+
+static enet_uint8 *
+enet_lz_write_sequence (enet_uint8 * outData, const enet_uint8 * outEnd, const enet_uint8 * literals, size_t literalLength, size_t offset, size_t matchLength)
+{
+    enet_uint8 * token;
+
+    if (outData >= outEnd)
+      return NULL;
+
+    token = outData ++;
+    * token = (enet_uint8) ((literalLength >= 15 ? 15 : literalLength) << 4);
+
+    if (literalLength >= 15)
+    {
+       outData = enet_lz_write_length (outData, outEnd, literalLength - 15);
+       if (outData == NULL)
+         return NULL;
+    }
+
+    if ((size_t) (outEnd - outData) < literalLength)
+      return NULL;
+    memcpy (outData, literals, literalLength);
+    outData += literalLength;
+
+    if (matchLength == 0)
+      return outData;
+
+    if (outEnd - outData < 2)
+      return NULL;
+    * outData ++ = (enet_uint8) (offset & 0xFF);
+    * outData ++ = (enet_uint8) (offset >> 8);
+
+    matchLength -= ENET_LZ_MINIMUM_MATCH;
+    * token |= (enet_uint8) (matchLength >= 15 ? 15 : matchLength);
+    if (matchLength >= 15)
+      outData = enet_lz_write_length (outData, outEnd, matchLength - 15);
+
+    return outData;
+}
+
+size_t
+enet_lz_compress (void * context, const ENetBuffer * inBuffers, size_t inBufferCount, size_t inLimit, enet_uint8 * outData, size_t outLimit)
+{
+    ENetLZ * lz = (ENetLZ *) context;
+    enet_uint8 * outStart = outData, * outEnd = outData + outLimit, * inData, * inEnd, * window;
+    const enet_uint8 * literals;
+    size_t inLength = 0;
+
+    if (lz == NULL || inLimit <= 0 || inLimit > ENET_PROTOCOL_MAXIMUM_MTU)
+      return 0;
+
+    window = lz -> window;
+    inData = window + lz -> dictionaryLength;
+
+    for (; inBufferCount > 0 && inLength < inLimit; -- inBufferCount, ++ inBuffers)
+    {
+       size_t length = inBuffers -> dataLength;
+       if (length > inLimit - inLength)
+         length = inLimit - inLength;
+       memcpy (inData + inLength, inBuffers -> data, length);
+       inLength += length;
+    }
+
+    inEnd = inData + inLength;
+    literals = inData;
+
+    memset (lz -> hashTable, 0, sizeof (lz -> hashTable));
+
+    while (inEnd - inData >= ENET_LZ_MINIMUM_MATCH)
+    {
+       enet_uint32 value = ENET_LZ_READ_32 (inData);
+       enet_uint16 * entry = & lz -> hashTable [ENET_LZ_HASH (value, ENET_LZ_HASH_BITS)];
+       const enet_uint8 * match = NULL;
+       size_t matchLength;
+
+       if (* entry != 0)
+       {
+          const enet_uint8 * candidate = window + lz -> dictionaryLength + * entry - 1;
+          if (ENET_LZ_READ_32 (candidate) == value)
+            match = candidate;
+       }
+       * entry = (enet_uint16) (inData - (window + lz -> dictionaryLength) + 1);
+
+       if (match == NULL && lz -> dictionaryLength > 0)
+       {
+          enet_uint16 dictionaryEntry = lz -> dictionaryHashTable [ENET_LZ_HASH (value, ENET_LZ_DICTIONARY_HASH_BITS)];
+          if (dictionaryEntry != 0)
+          {
+             const enet_uint8 * candidate = window + dictionaryEntry - 1;
+             if (inData - candidate <= ENET_LZ_MAXIMUM_OFFSET && ENET_LZ_READ_32 (candidate) == value)
+               match = candidate;
+          }
+       }
+
+       if (match == NULL)
+       {
+          ++ inData;
+          continue;
+       }
+
+       for (matchLength = ENET_LZ_MINIMUM_MATCH;
+            inData + matchLength < inEnd && match [matchLength] == inData [matchLength];
+            ++ matchLength) ;
+
+       outData = enet_lz_write_sequence (outData, outEnd, literals, inData - literals, inData - match, matchLength);
+       if (outData == NULL)
+         return 0;
+
+       inData += matchLength;
+       literals = inData;
+    }
+
+    outData = enet_lz_write_sequence (outData, outEnd, literals, inEnd - literals, 0, 0);
+    if (outData == NULL)
+      return 0;
+
+    return (size_t) (outData - outStart);
+}
+
+static int
+enet_lz_read_length (const enet_uint8 ** inData, const enet_uint8 * inEnd, size_t * length)
+{
+    enet_uint8 value;
+
+    do
+    {
+       if (* inData >= inEnd)
+         return -1;
+       value = * (* inData) ++;
+       * length += value;
+    } while (value == 255);
+
+    return 0;
+}
+
+size_t
+enet_lz_decompress (void * context, const enet_uint8 * inData, size_t inLimit, enet_uint8 * outData, size_t outLimit)
+{
+    ENetLZ * lz = (ENetLZ *) context;
+    const enet_uint8 * inEnd = inData + inLimit;
+    enet_uint8 * outStart = outData, * outEnd = outData + outLimit;
+
+    if (lz == NULL)
+      return 0;
+
+    while (inData < inEnd)
+    {
+       enet_uint8 token = * inData ++;
+       size_t literalLength = token >> 4, matchLength, offset;
+
+       if (literalLength == 15 && enet_lz_read_length (& inData, inEnd, & literalLength) < 0)
+         return 0;
+
+       if ((size_t) (inEnd - inData) < literalLength || (size_t) (outEnd - outData) < literalLength)
+         return 0;
+       memcpy (outData, inData, literalLength);
+       inData += literalLength;
+       outData += literalLength;
+
+       if (inData >= inEnd)
+         break;
+
+       if (inEnd - inData < 2)
+         return 0;
+       offset = inData [0] | (inData [1] << 8);
+       inData += 2;
+
+       matchLength = token & 15;
+       if (matchLength == 15 && enet_lz_read_length (& inData, inEnd, & matchLength) < 0)
+         return 0;
+       matchLength += ENET_LZ_MINIMUM_MATCH;
+
+       if (offset == 0 ||
+           offset > (size_t) (outData - outStart) + lz -> dictionaryLength ||
+           (size_t) (outEnd - outData) < matchLength)
+         return 0;
+
+       /* copy byte by byte since matches may overlap their own output or start in the dictionary */
+       for (; matchLength > 0; -- matchLength, ++ outData)
+       {
+          size_t distance = (size_t) (outData - outStart);
+
+          * outData = offset > distance ? lz -> window [lz -> dictionaryLength - (offset - distance)] : * (outData - offset);
+       }
+    }
+
+    return (size_t) (outData - outStart);
+}
+
+/* The trainer follows the idea of the COVER algorithm: the samples are split into as many
+   epochs as there are segments in the dictionary, and from each epoch the segment whose
+   ENET_LZ_TRAIN_KMER byte sequences occur in the most samples is taken. Sequences are
+   only counted once per sample, so structure shared between packets wins over repetition
+   within a single packet, and the sequences of a chosen segment no longer count towards
+   later ones. The best segments go last, where matches have the smallest offsets. */
+enum
+{
+    ENET_LZ_TRAIN_KMER = 8,
+    ENET_LZ_TRAIN_SEGMENT = 64,
+    ENET_LZ_TRAIN_HASH_BITS = 16,
+    ENET_LZ_TRAIN_HASH_SIZE = 1 << ENET_LZ_TRAIN_HASH_BITS
+};
+
+typedef struct _ENetLZSegment
+{
+    size_t offset;
+    enet_uint32 score;
+} ENetLZSegment;
+
+#define ENET_LZ_TRAIN_HASH(data) \
+    ENET_LZ_HASH (ENET_LZ_READ_32 (data) ^ (ENET_LZ_READ_32 ((data) + 4) * 2246822519U), ENET_LZ_TRAIN_HASH_BITS)
+
+static int
+enet_lz_compare_segments (const void * left, const void * right)
+{
+    enet_uint32 leftScore = ((const ENetLZSegment *) left) -> score,
+                rightScore = ((const ENetLZSegment *) right) -> score;
+
+    return leftScore < rightScore ? -1 : (leftScore > rightScore ? 1 : 0);
+}
+
+/** Builds a dictionary for enet_host_dictionary() from samples of typical packets.
+    @param samples sample packets, such as captured traffic
+    @param sampleCount number of samples
+    @param dictionary buffer that receives the dictionary
+    @param dictionaryLimit size of the buffer, at most ENET_LZ_DICTIONARY_MAXIMUM bytes are used
+    @returns the length of the dictionary, or 0 on failure
+*/
+size_t
+enet_lz_train_dictionary (const ENetBuffer * samples, size_t sampleCount, void * dictionary, size_t dictionaryLimit)
+{
+    enet_uint8 * data, * out = (enet_uint8 *) dictionary;
+    enet_uint16 * counts;
+    enet_uint32 * lastSample;
+    ENetLZSegment * segments;
+    size_t totalLength = 0, sampleIndex, position, segmentLimit, segmentCount = 0, epochLength, epochStart, dictionaryLength = 0;
+
+    if (dictionaryLimit > ENET_LZ_DICTIONARY_MAXIMUM)
+      dictionaryLimit = ENET_LZ_DICTIONARY_MAXIMUM;
+
+    for (sampleIndex = 0; sampleIndex < sampleCount; ++ sampleIndex)
+      totalLength += samples [sampleIndex].dataLength;
+
+    if (dictionaryLimit < ENET_LZ_TRAIN_SEGMENT || totalLength < ENET_LZ_TRAIN_SEGMENT)
+      return 0;
+
+    data = (enet_uint8 *) enet_malloc (totalLength);
+    counts = (enet_uint16 *) enet_malloc (ENET_LZ_TRAIN_HASH_SIZE * sizeof (enet_uint16));
+    lastSample = (enet_uint32 *) enet_malloc (ENET_LZ_TRAIN_HASH_SIZE * sizeof (enet_uint32));
+    segmentLimit = dictionaryLimit / ENET_LZ_TRAIN_SEGMENT;
+    segments = (ENetLZSegment *) enet_malloc (segmentLimit * sizeof (ENetLZSegment));
+    if (data == NULL || counts == NULL || lastSample == NULL || segments == NULL)
+      goto done;
+
+    memset (counts, 0, ENET_LZ_TRAIN_HASH_SIZE * sizeof (enet_uint16));
+    memset (lastSample, 0, ENET_LZ_TRAIN_HASH_SIZE * sizeof (enet_uint32));
+
+    for (sampleIndex = 0, position = 0; sampleIndex < sampleCount; ++ sampleIndex)
+    {
+       const enet_uint8 * sample = (const enet_uint8 *) samples [sampleIndex].data;
+       size_t sampleLength = samples [sampleIndex].dataLength, offset;
+
+       memcpy (data + position, sample, sampleLength);
+       position += sampleLength;
+
+       for (offset = 0; offset + ENET_LZ_TRAIN_KMER <= sampleLength; ++ offset)
+       {
+          enet_uint32 hash = ENET_LZ_TRAIN_HASH (sample + offset);
+
+          if (lastSample [hash] == sampleIndex + 1)
+            continue;
+          lastSample [hash] = (enet_uint32) (sampleIndex + 1);
+
+          if (counts [hash] < 0xFFFF)
+            ++ counts [hash];
+       }
+    }
+
+    epochLength = totalLength / segmentLimit;
+    if (epochLength < ENET_LZ_TRAIN_SEGMENT)
+      epochLength = ENET_LZ_TRAIN_SEGMENT;
+
+    for (epochStart = 0; epochStart + ENET_LZ_TRAIN_SEGMENT <= totalLength && segmentCount < segmentLimit; epochStart += epochLength)
+    {
+       size_t epochEnd = epochStart + epochLength, bestOffset = epochStart;
+       enet_uint32 score = 0, bestScore = 0;
+
+       if (epochEnd > totalLength)
+         epochEnd = totalLength;
+
+       /* slide a window of the k-mers starting within a segment across the epoch */
+       for (position = epochStart; position + ENET_LZ_TRAIN_KMER <= epochEnd; ++ position)
+       {
+          score += counts [ENET_LZ_TRAIN_HASH (data + position)];
+
+          if (position >= epochStart + ENET_LZ_TRAIN_SEGMENT - ENET_LZ_TRAIN_KMER + 1)
+            score -= counts [ENET_LZ_TRAIN_HASH (data + position - (ENET_LZ_TRAIN_SEGMENT - ENET_LZ_TRAIN_KMER + 1))];
+
+          if (position + ENET_LZ_TRAIN_KMER >= epochStart + ENET_LZ_TRAIN_SEGMENT && score > bestScore)
+          {
+             bestScore = score;
+             bestOffset = position + ENET_LZ_TRAIN_KMER - ENET_LZ_TRAIN_SEGMENT;
+          }
+       }
+
+       /* a score of one per k-mer means nothing in the segment recurs across samples */
+       if (bestScore <= ENET_LZ_TRAIN_SEGMENT - ENET_LZ_TRAIN_KMER + 1)
+         continue;
+
+       segments [segmentCount].offset = bestOffset;
+       segments [segmentCount].score = bestScore;
+       ++ segmentCount;
+
+       for (position = bestOffset; position + ENET_LZ_TRAIN_KMER <= bestOffset + ENET_LZ_TRAIN_SEGMENT; ++ position)
+         counts [ENET_LZ_TRAIN_HASH (data + position)] = 0;
+    }
+
+    qsort (segments, segmentCount, sizeof (ENetLZSegment), enet_lz_compare_segments);
+
+    for (sampleIndex = 0; sampleIndex < segmentCount; ++ sampleIndex)
+    {
+       memcpy (out + dictionaryLength, data + segments [sampleIndex].offset, ENET_LZ_TRAIN_SEGMENT);
+       dictionaryLength += ENET_LZ_TRAIN_SEGMENT;
+    }
+
+done:
+    if (segments != NULL)
+      enet_free (segments);
+    if (lastSample != NULL)
+      enet_free (lastSample);
+    if (counts != NULL)
+      enet_free (counts);
+    if (data != NULL)
+      enet_free (data);
+
+    return dictionaryLength;
+}
+
+/* Reliable packets of a channel are delivered exactly once and in order, so both ends can
+   keep the same history of the packets that were stream compressed and let matches reach
+   back into it. The history sits at the start of the buffer with the packet being worked on
+   right after it, and once the buffer fills only the most recent ENET_LZ_STREAM_WINDOW_SIZE
+   bytes of history are kept. A packet only joins the history once it is committed. */
+enum
+{
+    ENET_LZ_STREAM_BUFFER_SIZE = 2 * ENET_LZ_STREAM_WINDOW_SIZE + ENET_LZ_STREAM_MAXIMUM_PACKET_SIZE,
+    ENET_LZ_STREAM_HASH_BITS = 12,
+    ENET_LZ_STREAM_HASH_SIZE = 1 << ENET_LZ_STREAM_HASH_BITS
+};
+
+struct _ENetLZStream
+{
+    enet_uint8 buffer [ENET_LZ_STREAM_BUFFER_SIZE];
+    size_t historyLength;
+    /* positions + 1 within the buffer of the last occurrence of each hashed sequence,
+       only kept by the compressing end */
+    enet_uint32 * hashTable;
+};
+
+ENetLZStream *
+enet_lz_stream_create (int compressing)
+{
+    ENetLZStream * stream = (ENetLZStream *) enet_malloc (sizeof (ENetLZStream));
+    if (stream == NULL)
+      return NULL;
+
+    stream -> historyLength = 0;
+    stream -> hashTable = NULL;
+
+    if (compressing)
+    {
+       stream -> hashTable = (enet_uint32 *) enet_malloc (ENET_LZ_STREAM_HASH_SIZE * sizeof (enet_uint32));
+       if (stream -> hashTable == NULL)
+       {
+          enet_free (stream);
+
+          return NULL;
+       }
+
+       memset (stream -> hashTable, 0, ENET_LZ_STREAM_HASH_SIZE * sizeof (enet_uint32));
+    }
+
+    return stream;
+}
+
+void
+enet_lz_stream_destroy (ENetLZStream * stream)
+{
+    if (stream == NULL)
+      return;
+
+    if (stream -> hashTable != NULL)
+      enet_free (stream -> hashTable);
+
+    enet_free (stream);
+}
+
+/** Adds the packet last passed to enet_lz_stream_compress() or enet_lz_stream_decompress() to the history. */
+void
+enet_lz_stream_commit (ENetLZStream * stream, size_t length)
+{
+    size_t discard, entry;
+
+    /* only committed packets may decide when the history moves, or else the two ends
+       would disagree about how far back matches can reach */
+    stream -> historyLength += length;
+    if (stream -> historyLength + ENET_LZ_STREAM_MAXIMUM_PACKET_SIZE <= ENET_LZ_STREAM_BUFFER_SIZE)
+      return;
+
+    discard = stream -> historyLength - ENET_LZ_STREAM_WINDOW_SIZE;
+
+    memmove (stream -> buffer, stream -> buffer + discard, ENET_LZ_STREAM_WINDOW_SIZE);
+    stream -> historyLength = ENET_LZ_STREAM_WINDOW_SIZE;
+
+    if (stream -> hashTable == NULL)
+      return;
+
+    for (entry = 0; entry < ENET_LZ_STREAM_HASH_SIZE; ++ entry)
+      stream -> hashTable [entry] = stream -> hashTable [entry] > discard ? stream -> hashTable [entry] - (enet_uint32) discard : 0;
+}
+
+/** Compresses a packet against the history of the stream without adding it to the history.
+    @returns the compressed length, or 0 if the packet could not be compressed into outLimit bytes
+*/
+size_t
+enet_lz_stream_compress (ENetLZStream * stream, const enet_uint8 * inData, size_t inLength, enet_uint8 * outData, size_t outLimit)
+{
+    enet_uint8 * outStart = outData, * outEnd = outData + outLimit, * current, * inEnd;
+    const enet_uint8 * literals;
+
+    if (stream -> hashTable == NULL || inLength <= 0 || inLength > ENET_LZ_STREAM_MAXIMUM_PACKET_SIZE)
+      return 0;
+
+    current = stream -> buffer + stream -> historyLength;
+    memcpy (current, inData, inLength);
+    inEnd = current + inLength;
+    literals = current;
+
+    while (inEnd - current >= ENET_LZ_MINIMUM_MATCH)
+    {
+       enet_uint32 value = ENET_LZ_READ_32 (current);
+       enet_uint32 * entry = & stream -> hashTable [ENET_LZ_HASH (value, ENET_LZ_STREAM_HASH_BITS)];
+       const enet_uint8 * match = NULL;
+       size_t matchLength;
+
+       /* entries may be left over from packets that were never committed, so only
+          trust those that precede the current position */
+       if (* entry != 0)
+       {
+          const enet_uint8 * candidate = stream -> buffer + * entry - 1;
+          if (candidate < current && current - candidate <= ENET_LZ_MAXIMUM_OFFSET && ENET_LZ_READ_32 (candidate) == value)
+            match = candidate;
+       }
+       * entry = (enet_uint32) (current - stream -> buffer + 1);
+
+       if (match == NULL)
+       {
+          ++ current;
+          continue;
+       }
+
+       for (matchLength = ENET_LZ_MINIMUM_MATCH;
+            current + matchLength < inEnd && match [matchLength] == current [matchLength];
+            ++ matchLength) ;
+
+       outData = enet_lz_write_sequence (outData, outEnd, literals, current - literals, current - match, matchLength);
+       if (outData == NULL)
+         return 0;
+
+       current += matchLength;
+       literals = current;
+    }
+
+    outData = enet_lz_write_sequence (outData, outEnd, literals, inEnd - literals, 0, 0);
+    if (outData == NULL)
+      return 0;
+
+    return (size_t) (outData - outStart);
+}
+
+/** Decompresses a packet of outLength bytes against the history of the stream without adding it to the history.
+    @returns the decompressed data, valid until the stream is next used, or NULL on malformed input
+*/
+const enet_uint8 *
+enet_lz_stream_decompress (ENetLZStream * stream, const enet_uint8 * inData, size_t inLimit, size_t outLength)
+{
+    const enet_uint8 * inEnd = inData + inLimit;
+    enet_uint8 * outStart, * outData, * outEnd;
+
+    if (outLength <= 0 || outLength > ENET_LZ_STREAM_MAXIMUM_PACKET_SIZE)
+      return NULL;
+
+    outStart = outData = stream -> buffer + stream -> historyLength;
+    outEnd = outStart + outLength;
+
+    while (inData < inEnd)
+    {
+       enet_uint8 token = * inData ++;
+       size_t literalLength = token >> 4, matchLength, offset;
+
+       if (literalLength == 15 && enet_lz_read_length (& inData, inEnd, & literalLength) < 0)
+         return NULL;
+
+       if ((size_t) (inEnd - inData) < literalLength || (size_t) (outEnd - outData) < literalLength)
+         return NULL;
+       memcpy (outData, inData, literalLength);
+       inData += literalLength;
+       outData += literalLength;
+
+       if (inData >= inEnd)
+         break;
+
+       if (inEnd - inData < 2)
+         return NULL;
+       offset = inData [0] | (inData [1] << 8);
+       inData += 2;
+
+       matchLength = token & 15;
+       if (matchLength == 15 && enet_lz_read_length (& inData, inEnd, & matchLength) < 0)
+         return NULL;
+       matchLength += ENET_LZ_MINIMUM_MATCH;
+
+       if (offset == 0 ||
+           offset > (size_t) (outData - stream -> buffer) ||
+           (size_t) (outEnd - outData) < matchLength)
+         return NULL;
+
+       for (; matchLength > 0; -- matchLength, ++ outData)
+         * outData = * (outData - offset);
+    }
+
+    if (outData != outEnd)
+      return NULL;
+
+    return outStart;
+}
+
+/** @defgroup host ENet host functions
+    @{
+*/
+
+/** Sets the packet compressor the host should use to the fast LZ compressor.
+    Both ends of a connection must use the same dictionary.
+    @param host host to enable the LZ compressor for
+    @param dictionary data to prime the compressor with, or NULL for none
+    @param dictionaryLength length of the dictionary, at most ENET_LZ_DICTIONARY_MAXIMUM bytes
+    @returns 0 on success, < 0 on failure
+*/
+int
+enet_host_compress_with_fast_lz (ENetHost * host, const void * dictionary, size_t dictionaryLength)
+{
+    ENetCompressor compressor;
+    memset (& compressor, 0, sizeof (compressor));
+    compressor.context = enet_lz_create (dictionary, dictionaryLength);
+    if (compressor.context == NULL)
+      return -1;
+    compressor.compress = enet_lz_compress;
+    compressor.decompress = enet_lz_decompress;
+    compressor.destroy = enet_lz_destroy;
+    enet_host_compress (host, & compressor);
+    return 0;
+}
+
+/** Sets the dictionary the host offers to peers when connecting. Datagrams exchanged with
+    peers that offer a dictionary with the same hash are compressed with the fast LZ compressor
+    primed with it, in place of the host's packet compressor.
+    @param host host to set the dictionary for
+    @param dictionary dictionary, such as one built by enet_lz_train_dictionary(), or NULL to remove it
+    @param dictionaryLength length of the dictionary, at most ENET_LZ_DICTIONARY_MAXIMUM bytes
+    @returns 0 on success, < 0 on failure
+    @remarks all peers that agreed on the dictionary share the host's compressor, so the dictionary
+    cannot be changed or removed while any of them is connected, or while a peer is still connecting
+    and might yet agree on it; it should be set before connecting
+*/
+int
+enet_host_dictionary (ENetHost * host, const void * dictionary, size_t dictionaryLength)
+{
+    ENetCompressor compressor;
+    ENetBuffer buffer;
+    ENetPeer * currentPeer;
+
+    for (currentPeer = host -> peers;
+         currentPeer < & host -> peers [host -> peerCount];
+         ++ currentPeer)
+    {
+       if (currentPeer -> state == ENET_PEER_STATE_DISCONNECTED)
+         continue;
+
+       if (currentPeer -> protocolFeatures & ENET_PROTOCOL_FEATURE_DICTIONARY ||
+           (host -> protocolFeatures & ENET_PROTOCOL_FEATURE_DICTIONARY && currentPeer -> state < ENET_PEER_STATE_CONNECTED))
+         return -1;
+    }
+
+    memset (& compressor, 0, sizeof (compressor));
+    if (dictionary != NULL && dictionaryLength > 0)
+    {
+       compressor.context = enet_lz_create (dictionary, dictionaryLength);
+       if (compressor.context == NULL)
+         return -1;
+       compressor.compress = enet_lz_compress;
+       compressor.decompress = enet_lz_decompress;
+       compressor.destroy = enet_lz_destroy;
+    }
+
+    if (host -> dictionaryCompressor.context != NULL && host -> dictionaryCompressor.destroy)
+      (* host -> dictionaryCompressor.destroy) (host -> dictionaryCompressor.context);
+
+    host -> dictionaryCompressor = compressor;
+
+    if (compressor.context == NULL)
+    {
+       host -> dictionaryHash = 0;
+       host -> protocolFeatures &= ~ ENET_PROTOCOL_FEATURE_DICTIONARY;
+
+       return 0;
+    }
+
+    buffer.data = (void *) dictionary;
+    buffer.dataLength = dictionaryLength;
+
+    /* 0 stands for no dictionary in the handshake */
+    host -> dictionaryHash = enet_crc32 (& buffer, 1);
+    if (host -> dictionaryHash == 0)
+      host -> dictionaryHash = 1;
+    host -> protocolFeatures |= ENET_PROTOCOL_FEATURE_DICTIONARY;
+
+    return 0;
+}
+
+/** @} */
@@ -4,12 +4,17 @@
 */
 #include <string.h>
 #define ENET_BUILDING_LIB 1
+#include "enet/utility.h"
 #include "enet/enet.h"
 
 /** @defgroup Packet ENet packet functions
     @{
 */
 
+#define ENET_PACKET_POOL_DATA(packet) ((packet) -> pool != NULL ? (enet_uint8 *) ((packet) + 1) : NULL)
+
+static void enet_packet_pool_release (ENetPacket *);
+
 /** Creates a packet that may be sent to a peer.
     @param data         initial contents of the packet's data; the packet's data will remain uninitialized if data is NULL.
     @param dataLength   size of the data allocated for this packet
@@ -46,6 +51,65 @@ enet_packet_create (const void * data, size_t dataLength, enet_uint32 flags)
     packet -> dataLength = dataLength;
     packet -> freeCallback = NULL;
     packet -> userData = NULL;
+    packet -> pool = NULL;
+    packet -> capacity = 0;
+    packet -> segments = NULL;
+    packet -> segmentCount = 0;
+    packet -> deadline = 0;
+
+    return packet;
+}
+
+/** Creates a packet whose data is gathered from other packets at send time rather than copied.
+    Each segment gains a reference that is released when the gather packet is destroyed, so a
+    segment may be shared between several gather packets and is destroyed along with the last of them.
+    The data field of the resulting packet is NULL and the packet may not be resized.
+    @param segments     packets whose data, in order, make up the contents of the packet; these may not themselves be gather packets
+    @param segmentCount number of segments, at most ENET_PACKET_MAXIMUM_SEGMENTS, or fewer where
+                        ENET_BUFFER_MAXIMUM is too small to send that many, see ENET_PACKET_GATHER_MAXIMUM
+    @param flags        flags for this packet as described for the ENetPacket structure.
+    @returns the packet on success, NULL on failure
+*/
+ENetPacket *
+enet_packet_create_gather (ENetPacket * const * segments, size_t segmentCount, enet_uint32 flags)
+{
+    ENetPacket * packet;
+    size_t segmentIndex, dataLength = 0;
+
+    if (segmentCount <= 0 || segmentCount > ENET_PACKET_GATHER_MAXIMUM)
+      return NULL;
+
+    for (segmentIndex = 0; segmentIndex < segmentCount; ++ segmentIndex)
+    {
+       if (segments [segmentIndex] -> segments != NULL)
+         return NULL;
+
+       dataLength += segments [segmentIndex] -> dataLength;
+    }
+
+    packet = (ENetPacket *) enet_malloc (sizeof (ENetPacket) + segmentCount * sizeof (ENetPacket *));
+    if (packet == NULL)
+      return NULL;
+
+    packet -> segments = (ENetPacket **) (packet + 1);
+    packet -> segmentCount = segmentCount;
+
+    for (segmentIndex = 0; segmentIndex < segmentCount; ++ segmentIndex)
+    {
+       packet -> segments [segmentIndex] = segments [segmentIndex];
+
+       ++ segments [segmentIndex] -> referenceCount;
+    }
+
+    packet -> referenceCount = 0;
+    packet -> flags = flags & ~ ENET_PACKET_FLAG_NO_ALLOCATE;
+    packet -> data = NULL;
+    packet -> dataLength = dataLength;
+    packet -> freeCallback = NULL;
+    packet -> userData = NULL;
+    packet -> pool = NULL;
+    packet -> capacity = 0;
+    packet -> deadline = 0;
 
     return packet;
 }
@@ -61,6 +125,26 @@ enet_packet_destroy (ENetPacket * packet)
 
     if (packet -> freeCallback != NULL)
       (* packet -> freeCallback) (packet);
+    if (packet -> pool != NULL)
+    {
+       enet_packet_pool_release (packet);
+       return;
+    }
+    if (packet -> segments != NULL)
+    {
+       size_t segmentIndex;
+
+       for (segmentIndex = 0; segmentIndex < packet -> segmentCount; ++ segmentIndex)
+       {
+          ENetPacket * segment = packet -> segments [segmentIndex];
+
+          if (-- segment -> referenceCount == 0)
+            enet_packet_destroy (segment);
+       }
+
+       enet_free (packet);
+       return;
+    }
     if (! (packet -> flags & ENET_PACKET_FLAG_NO_ALLOCATE) &&
         packet -> data != NULL)
       enet_free (packet -> data);
@@ -78,6 +162,9 @@ enet_packet_resize (ENetPacket * packet, size_t dataLength)
 {
     enet_uint8 * newData;
 
+    if (packet -> segments != NULL)
+      return -1;
+
     if (dataLength <= packet -> dataLength || (packet -> flags & ENET_PACKET_FLAG_NO_ALLOCATE))
     {
        packet -> dataLength = dataLength;
@@ -85,12 +172,20 @@ enet_packet_resize (ENetPacket * packet, size_t dataLength)
        return 0;
     }
 
+    if (packet -> data == ENET_PACKET_POOL_DATA (packet) && dataLength <= packet -> capacity)
+    {
+       packet -> dataLength = dataLength;
+
+       return 0;
+    }
+
     newData = (enet_uint8 *) enet_malloc (dataLength);
     if (newData == NULL)
       return -1;
 
     memcpy (newData, packet -> data, packet -> dataLength);
-    enet_free (packet -> data);
+    if (packet -> data != ENET_PACKET_POOL_DATA (packet))
+      enet_free (packet -> data);
 
     packet -> data = newData;
     packet -> dataLength = dataLength;
@@ -98,68 +193,237 @@ enet_packet_resize (ENetPacket * packet, size_t dataLength)
     return 0;
 }
 
-static int initializedCRC32 = 0;
-static enet_uint32 crcTable [256];
+/** Sets the time after which the packet is no longer worth sending unreliably.
+    Commands for the packet that are still waiting in an outgoing unreliable queue once the
+    deadline has passed are dropped instead of sent and counted in ENetPeer::packetsExpired.
+    Packets sent reliably, including unreliable packets too large to send without reliable
+    fragments, are always delivered.
+    @param packet packet to set the deadline of
+    @param deadline time, on the same clock as enet_time_get(), after which to drop the packet,
+    for example enet_time_get () + 100 for a time to live of 100 milliseconds
+*/
+void
+enet_packet_set_deadline (ENetPacket * packet, enet_uint32 deadline)
+{
+    packet -> deadline = deadline;
+    packet -> flags |= ENET_PACKET_FLAG_DEADLINE;
+}
+
+/** Counts the buffers needed to gather a range of the packet's data.
+    @param packet packet to gather from
+    @param offset offset of the range within the packet's data
+    @param length length of the range
+    @returns the number of buffers enet_packet_gather() will fill for this range
+*/
+size_t
+enet_packet_gather_count (const ENetPacket * packet, size_t offset, size_t length)
+{
+    size_t segmentIndex, bufferCount = 0;
+
+    if (packet -> segments == NULL)
+      return 1;
+
+    for (segmentIndex = 0; segmentIndex < packet -> segmentCount && length > 0; ++ segmentIndex)
+    {
+       const ENetPacket * segment = packet -> segments [segmentIndex];
+
+       if (offset >= segment -> dataLength)
+       {
+          offset -= segment -> dataLength;
+          continue;
+       }
+
+       ++ bufferCount;
+
+       length -= ENET_MIN (length, segment -> dataLength - offset);
+       offset = 0;
+    }
+
+    return bufferCount;
+}
 
-static enet_uint32
-reflect_crc (int val, int bits)
+/** Fills buffers referencing a range of the packet's data without copying it.
+    @param packet packet to gather from
+    @param offset offset of the range within the packet's data
+    @param length length of the range
+    @param buffers buffers to fill, which must have room for enet_packet_gather_count() entries
+    @returns the number of buffers filled
+*/
+size_t
+enet_packet_gather (const ENetPacket * packet, size_t offset, size_t length, ENetBuffer * buffers)
 {
-    int result = 0, bit;
+    ENetBuffer * buffer = buffers;
+    size_t segmentIndex;
 
-    for (bit = 0; bit < bits; bit ++)
+    if (packet -> segments == NULL)
     {
-        if(val & 1) result |= 1 << (bits - 1 - bit);
-        val >>= 1;
+       buffer -> data = packet -> data + offset;
+       buffer -> dataLength = length;
+
+       return 1;
     }
 
-    return result;
+    for (segmentIndex = 0; segmentIndex < packet -> segmentCount && length > 0; ++ segmentIndex)
+    {
+       const ENetPacket * segment = packet -> segments [segmentIndex];
+
+       if (offset >= segment -> dataLength)
+       {
+          offset -= segment -> dataLength;
+          continue;
+       }
+
+       buffer -> data = segment -> data + offset;
+       buffer -> dataLength = ENET_MIN (length, segment -> dataLength - offset);
+
+       length -= buffer -> dataLength;
+       offset = 0;
+
+       ++ buffer;
+    }
+
+    return buffer - buffers;
+}
+
+/** @} */
+
+ENetPacketPool *
+enet_packet_pool_create (void)
+{
+    ENetPacketPool * pool = (ENetPacketPool *) enet_malloc (sizeof (ENetPacketPool));
+    if (pool == NULL)
+      return NULL;
+
+    memset (pool, 0, sizeof (ENetPacketPool));
+
+    pool -> referenceCount = 1;
+
+    return pool;
 }
 
 static void
-initialize_crc32 (void)
+enet_packet_pool_flush (ENetPacketPool * pool)
 {
-    int byte;
+    int sizeClass;
 
-    for (byte = 0; byte < 256; ++ byte)
+    for (sizeClass = 0; sizeClass < ENET_PACKET_POOL_SIZE_CLASSES; ++ sizeClass)
     {
-        enet_uint32 crc = reflect_crc (byte, 8) << 24;
-        int offset;
-
-        for(offset = 0; offset < 8; ++ offset)
-        {
-            if (crc & 0x80000000)
-                crc = (crc << 1) ^ 0x04c11db7;
-            else
-                crc <<= 1;
-        }
-
-        crcTable [byte] = reflect_crc (crc, 32);
+       while (pool -> freePackets [sizeClass] != NULL)
+       {
+          ENetPacket * packet = pool -> freePackets [sizeClass];
+
+          pool -> freePackets [sizeClass] = (ENetPacket *) packet -> userData;
+
+          enet_free (packet);
+       }
+
+       pool -> freeCount [sizeClass] = 0;
     }
+}
+
+/** Releases the host's reference to the pool. Cached blocks are freed immediately,
+    while the pool itself is kept alive until every packet allocated from it has been destroyed.
+*/
+void
+enet_packet_pool_destroy (ENetPacketPool * pool)
+{
+    if (pool == NULL)
+      return;
+
+    enet_packet_pool_flush (pool);
 
-    initializedCRC32 = 1;
+    pool -> closed = 1;
+
+    if (-- pool -> referenceCount == 0)
+      enet_free (pool);
 }
 
-enet_uint32
-enet_crc32 (const ENetBuffer * buffers, size_t bufferCount)
+static void
+enet_packet_pool_release (ENetPacket * packet)
 {
-    enet_uint32 crc = 0xFFFFFFFF;
+    ENetPacketPool * pool = packet -> pool;
+    int sizeClass = 0;
 
-    if (! initializedCRC32) initialize_crc32 ();
+    if (packet -> data != ENET_PACKET_POOL_DATA (packet))
+      enet_free (packet -> data);
 
-    while (bufferCount -- > 0)
+    while ((size_t) (ENET_PACKET_POOL_MINIMUM_SIZE << sizeClass) < packet -> capacity)
+      ++ sizeClass;
+
+    if (! pool -> closed && pool -> freeCount [sizeClass] < ENET_PACKET_POOL_MAXIMUM_FREE)
     {
-        const enet_uint8 * data = (const enet_uint8 *) buffers -> data,
-                         * dataEnd = & data [buffers -> dataLength];
+       /* the free list is threaded through userData, which is unused while the block is cached */
+       packet -> userData = pool -> freePackets [sizeClass];
+       pool -> freePackets [sizeClass] = packet;
+       ++ pool -> freeCount [sizeClass];
+    }
+    else
+      enet_free (packet);
 
-        while (data < dataEnd)
-        {
-            crc = (crc >> 8) ^ crcTable [(crc & 0xFF) ^ *data++];
-        }
+    if (-- pool -> referenceCount == 0)
+      enet_free (pool);
+}
 
-        ++ buffers;
+/** @defgroup host ENet host functions
+    @{
+*/
+
+/** Creates a packet that may be sent to a peer, allocating it from the host's packet pool.
+    Packets of up to ENET_PACKET_POOL_MAXIMUM_SIZE bytes are stored together with their data
+    in a single block that is recycled by enet_packet_destroy(); larger packets and packets
+    using ENET_PACKET_FLAG_NO_ALLOCATE are created as by enet_packet_create(). The pool is not
+    thread-safe, so packets created this way must be destroyed on the thread servicing the host.
+    Packets received from peers are not taken from the pool and may be destroyed on any thread.
+    @param host         host whose packet pool the packet is allocated from
+    @param data         initial contents of the packet's data; the packet's data will remain uninitialized if data is NULL.
+    @param dataLength   size of the data allocated for this packet
+    @param flags        flags for this packet as described for the ENetPacket structure.
+    @returns the packet on success, NULL on failure
+*/
+ENetPacket *
+enet_host_packet_create (ENetHost * host, const void * data, size_t dataLength, enet_uint32 flags)
+{
+    ENetPacketPool * pool = host -> packetPool;
+    ENetPacket * packet;
+    int sizeClass = 0;
+
+    if (pool == NULL || dataLength > ENET_PACKET_POOL_MAXIMUM_SIZE || (flags & ENET_PACKET_FLAG_NO_ALLOCATE))
+      return enet_packet_create (data, dataLength, flags);
+
+    while ((size_t) (ENET_PACKET_POOL_MINIMUM_SIZE << sizeClass) < dataLength)
+      ++ sizeClass;
+
+    packet = pool -> freePackets [sizeClass];
+    if (packet != NULL)
+    {
+       pool -> freePackets [sizeClass] = (ENetPacket *) packet -> userData;
+       -- pool -> freeCount [sizeClass];
     }
+    else
+    {
+       packet = (ENetPacket *) enet_malloc (sizeof (ENetPacket) + (ENET_PACKET_POOL_MINIMUM_SIZE << sizeClass));
+       if (packet == NULL)
+         return NULL;
+    }
+
+    ++ pool -> referenceCount;
 
-    return ENET_HOST_TO_NET_32 (~ crc);
+    packet -> pool = pool;
+    packet -> capacity = ENET_PACKET_POOL_MINIMUM_SIZE << sizeClass;
+    packet -> data = (enet_uint8 *) (packet + 1);
+    if (data != NULL)
+      memcpy (packet -> data, data, dataLength);
+
+    packet -> referenceCount = 0;
+    packet -> flags = flags;
+    packet -> dataLength = dataLength;
+    packet -> freeCallback = NULL;
+    packet -> userData = NULL;
+    packet -> segments = NULL;
+    packet -> segmentCount = 0;
+    packet -> deadline = 0;
+
+    return packet;
 }
 
 /** @} */
@@ -4,7 +4,10 @@
 */
 #include <string.h>
 #define ENET_BUILDING_LIB 1
+#include "enet/utility.h"
+#include "enet/time.h"
 #include "enet/enet.h"
+#include "enet/internal/trace.h"
 
 /** @defgroup peer ENet peer functions
     @{
@@ -64,6 +67,8 @@ enet_peer_throttle (ENetPeer * peer, enet_uint32 rtt)
     if (peer -> lastRoundTripTime <= peer -> lastRoundTripTimeVariance)
     {
         peer -> packetThrottle = peer -> packetThrottleLimit;
+
+        ENET_PROBE3 (peer__throttle, peer, peer -> packetThrottle, rtt);
     }
     else
     if (rtt < peer -> lastRoundTripTime)
@@ -73,6 +78,8 @@ enet_peer_throttle (ENetPeer * peer, enet_uint32 rtt)
         if (peer -> packetThrottle > peer -> packetThrottleLimit)
           peer -> packetThrottle = peer -> packetThrottleLimit;
 
+        ENET_PROBE3 (peer__throttle, peer, peer -> packetThrottle, rtt);
+
         return 1;
     }
     else
@@ -83,6 +90,8 @@ enet_peer_throttle (ENetPeer * peer, enet_uint32 rtt)
         else
           peer -> packetThrottle = 0;
 
+        ENET_PROBE3 (peer__throttle, peer, peer -> packetThrottle, rtt);
+
         return -1;
     }
 
@@ -99,19 +108,53 @@ enet_peer_throttle (ENetPeer * peer, enet_uint32 rtt)
 int
 enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
 {
-   ENetChannel * channel = & peer -> channels [channelID];
-   ENetProtocol command;
-   size_t fragmentLength;
-
    if (peer -> state != ENET_PEER_STATE_CONNECTED ||
        channelID >= peer -> channelCount ||
        packet -> dataLength > peer -> host -> maximumPacketSize)
      return -1;
 
-   fragmentLength = peer -> mtu - sizeof (ENetProtocolHeader) - sizeof (ENetProtocolSendFragment);
+   return enet_peer_queue_packet (peer, channelID, packet, enet_peer_fragment_length (peer));
+}
+
+/** Returns the largest amount of packet data that fits in a single fragment sent to the peer. */
+size_t
+enet_peer_fragment_length (ENetPeer * peer)
+{
+   size_t fragmentLength = peer -> mtu - sizeof (ENetProtocolHeader) - sizeof (ENetProtocolSendFragment);
    if (peer -> host -> checksum != NULL)
      fragmentLength -= sizeof(enet_uint32);
 
+   return fragmentLength;
+}
+
+/* Fills in the command for a packet that fits in a single command, leaving the channel ID to the caller. */
+static void
+enet_peer_setup_packet_command (ENetChannel * channel, ENetPacket * packet, enet_uint8 commandFlags, ENetProtocol * command)
+{
+   if ((packet -> flags & (ENET_PACKET_FLAG_RELIABLE | ENET_PACKET_FLAG_UNSEQUENCED)) == ENET_PACKET_FLAG_UNSEQUENCED)
+   {
+      command -> header.command = ENET_PROTOCOL_COMMAND_SEND_UNSEQUENCED | ENET_PROTOCOL_COMMAND_FLAG_UNSEQUENCED | commandFlags;
+      command -> sendUnsequenced.dataLength = ENET_HOST_TO_NET_16 (packet -> dataLength);
+   }
+   else
+   if (packet -> flags & ENET_PACKET_FLAG_RELIABLE || channel -> outgoingUnreliableSequenceNumber >= 0xFFFF)
+   {
+      command -> header.command = ENET_PROTOCOL_COMMAND_SEND_RELIABLE | ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE | commandFlags;
+      command -> sendReliable.dataLength = ENET_HOST_TO_NET_16 (packet -> dataLength);
+   }
+   else
+   {
+      command -> header.command = ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE | commandFlags;
+      command -> sendUnreliable.dataLength = ENET_HOST_TO_NET_16 (packet -> dataLength);
+   }
+}
+
+static int
+enet_peer_queue_packet_commands (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet, size_t fragmentLength, enet_uint8 commandFlags)
+{
+   ENetChannel * channel = & peer -> channels [channelID];
+   ENetProtocol command;
+
    if (packet -> dataLength > fragmentLength)
    {
       enet_uint32 fragmentCount = (packet -> dataLength + fragmentLength - 1) / fragmentLength,
@@ -125,18 +168,38 @@ enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
       if (fragmentCount > ENET_PROTOCOL_MAXIMUM_FRAGMENT_COUNT)
         return -1;
 
-      if ((packet -> flags & (ENET_PACKET_FLAG_RELIABLE | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT)) == ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT &&
-          channel -> outgoingUnreliableSequenceNumber < 0xFFFF)
-      {
-         commandNumber = ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE_FRAGMENT;
-         startSequenceNumber = ENET_HOST_TO_NET_16 (channel -> outgoingUnreliableSequenceNumber + 1);
-      }
-      else
+      if ((packet -> flags & (ENET_PACKET_FLAG_RELIABLE | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT)) != ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT ||
+          channel -> outgoingUnreliableSequenceNumber >= 0xFFFF)
       {
-         commandNumber = ENET_PROTOCOL_COMMAND_SEND_FRAGMENT | ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE;
-         startSequenceNumber = ENET_HOST_TO_NET_16 (channel -> outgoingReliableSequenceNumber + 1);
+         /* reliable fragments are queued as a single transfer command that hands out
+            one fragment at a time as the reliable window admits them */
+         fragment = (ENetOutgoingCommand *) enet_object_pool_allocate (& peer -> host -> outgoingCommandPool);
+         if (fragment == NULL)
+           return -1;
+
+         fragment -> fragmentOffset = 0;
+         fragment -> fragmentLength = fragmentLength;
+         fragment -> fragmentsRemaining = fragmentCount;
+         fragment -> packet = packet;
+         fragment -> command.header.command = ENET_PROTOCOL_COMMAND_SEND_FRAGMENT | ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE | commandFlags;
+         fragment -> command.header.channelID = channelID;
+         fragment -> command.sendFragment.startSequenceNumber = ENET_HOST_TO_NET_16 (channel -> outgoingReliableSequenceNumber + 1);
+         fragment -> command.sendFragment.dataLength = ENET_HOST_TO_NET_16 (fragmentLength);
+         fragment -> command.sendFragment.fragmentCount = ENET_HOST_TO_NET_32 (fragmentCount);
+         fragment -> command.sendFragment.fragmentNumber = 0;
+         fragment -> command.sendFragment.totalLength = ENET_HOST_TO_NET_32 (packet -> dataLength);
+         fragment -> command.sendFragment.fragmentOffset = 0;
+
+         ++ packet -> referenceCount;
+
+         enet_peer_setup_outgoing_command (peer, fragment);
+
+         return 0;
       }
 
+      commandNumber = ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE_FRAGMENT;
+      startSequenceNumber = ENET_HOST_TO_NET_16 (channel -> outgoingUnreliableSequenceNumber + 1);
+
       enet_list_clear (& fragments);
 
       for (fragmentNumber = 0,
@@ -148,14 +211,14 @@ enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
          if (packet -> dataLength - fragmentOffset < fragmentLength)
            fragmentLength = packet -> dataLength - fragmentOffset;
 
-         fragment = (ENetOutgoingCommand *) enet_malloc (sizeof (ENetOutgoingCommand));
+         fragment = (ENetOutgoingCommand *) enet_object_pool_allocate (& peer -> host -> outgoingCommandPool);
          if (fragment == NULL)
          {
             while (! enet_list_empty (& fragments))
             {
                fragment = (ENetOutgoingCommand *) enet_list_remove (enet_list_begin (& fragments));
 
-               enet_free (fragment);
+               enet_object_pool_free (& peer -> host -> outgoingCommandPool, fragment);
             }
 
             return -1;
@@ -163,6 +226,7 @@ enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
 
          fragment -> fragmentOffset = fragmentOffset;
          fragment -> fragmentLength = fragmentLength;
+         fragment -> fragmentsRemaining = 0;
          fragment -> packet = packet;
          fragment -> command.header.command = commandNumber;
          fragment -> command.header.channelID = channelID;
@@ -190,33 +254,553 @@ enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
 
    command.header.channelID = channelID;
 
-   if ((packet -> flags & (ENET_PACKET_FLAG_RELIABLE | ENET_PACKET_FLAG_UNSEQUENCED)) == ENET_PACKET_FLAG_UNSEQUENCED)
+   enet_peer_setup_packet_command (channel, packet, commandFlags, & command);
+
+   if (enet_peer_queue_outgoing_command (peer, & command, packet, 0, packet -> dataLength) == NULL)
+     return -1;
+
+   return 0;
+}
+
+static void
+enet_peer_release_uncompressed_packet (ENetPacket * packet)
+{
+   ENetPacket * uncompressedPacket = (ENetPacket *) packet -> userData;
+
+   -- uncompressedPacket -> referenceCount;
+
+   if (uncompressedPacket -> referenceCount == 0)
    {
-      command.header.command = ENET_PROTOCOL_COMMAND_SEND_UNSEQUENCED | ENET_PROTOCOL_COMMAND_FLAG_UNSEQUENCED;
-      command.sendUnsequenced.dataLength = ENET_HOST_TO_NET_16 (packet -> dataLength);
+      uncompressedPacket -> flags |= packet -> flags & ENET_PACKET_FLAG_SENT;
+
+      enet_packet_destroy (uncompressedPacket);
    }
-   else
-   if (packet -> flags & ENET_PACKET_FLAG_RELIABLE || channel -> outgoingUnreliableSequenceNumber >= 0xFFFF)
+}
+
+/** Compresses a reliable packet against the history of the channel. The compressed packet
+    holds a reference to the original one until it is destroyed, so the original is released
+    exactly as if it had been queued itself.
+    @returns the compressed packet, or NULL if the packet did not shrink or on failure
+*/
+static ENetPacket *
+enet_peer_compress_packet (ENetPeer * peer, ENetChannel * channel, ENetPacket * packet)
+{
+   ENetPacket * compressedPacket;
+   size_t compressedLength;
+
+   if (packet -> dataLength <= sizeof (enet_uint16) + 1)
+     return NULL;
+
+   if (channel -> outgoingStream == NULL)
    {
-      command.header.command = ENET_PROTOCOL_COMMAND_SEND_RELIABLE | ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE;
-      command.sendReliable.dataLength = ENET_HOST_TO_NET_16 (packet -> dataLength);
+      channel -> outgoingStream = enet_lz_stream_create (1);
+      if (channel -> outgoingStream == NULL)
+        return NULL;
    }
-   else
+
+   compressedPacket = enet_host_packet_create (peer -> host, NULL, packet -> dataLength,
+                         (packet -> flags & ~ (ENET_PACKET_FLAG_NO_ALLOCATE | ENET_PACKET_FLAG_SENT)) | ENET_PACKET_FLAG_NO_COMPRESS);
+   if (compressedPacket == NULL)
+     return NULL;
+
+   compressedLength = enet_lz_stream_compress (channel -> outgoingStream, packet -> data, packet -> dataLength,
+                                               compressedPacket -> data + sizeof (enet_uint16), packet -> dataLength - sizeof (enet_uint16) - 1);
+   if (compressedLength == 0)
    {
-      command.header.command = ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE;
-      command.sendUnreliable.dataLength = ENET_HOST_TO_NET_16 (packet -> dataLength);
+      enet_packet_destroy (compressedPacket);
+
+      return NULL;
    }
 
-   if (enet_peer_queue_outgoing_command (peer, & command, packet, 0, packet -> dataLength) == NULL)
+   compressedPacket -> data [0] = (enet_uint8) (packet -> dataLength >> 8);
+   compressedPacket -> data [1] = (enet_uint8) (packet -> dataLength & 0xFF);
+   compressedPacket -> dataLength = sizeof (enet_uint16) + compressedLength;
+   compressedPacket -> userData = packet;
+   compressedPacket -> freeCallback = enet_peer_release_uncompressed_packet;
+
+   ++ packet -> referenceCount;
+
+   return compressedPacket;
+}
+
+/* Queues a packet with the given command flags, stream compressing it first if it is reliable and the peer agreed to it. */
+static int
+enet_peer_queue_compressible_packet (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet, size_t fragmentLength, enet_uint8 commandFlags)
+{
+   ENetChannel * channel = & peer -> channels [channelID];
+   ENetPacket * compressedPacket;
+
+   if (! (peer -> protocolFeatures & ENET_PROTOCOL_FEATURE_STREAM_COMPRESSION) ||
+       (packet -> flags & (ENET_PACKET_FLAG_RELIABLE | ENET_PACKET_FLAG_NO_COMPRESS)) != ENET_PACKET_FLAG_RELIABLE ||
+       packet -> segments != NULL ||
+       packet -> dataLength > ENET_LZ_STREAM_MAXIMUM_PACKET_SIZE)
+     return enet_peer_queue_packet_commands (peer, channelID, packet, fragmentLength, commandFlags);
+
+   compressedPacket = enet_peer_compress_packet (peer, channel, packet);
+   if (compressedPacket == NULL)
+     return enet_peer_queue_packet_commands (peer, channelID, packet, fragmentLength, commandFlags);
+
+   if (enet_peer_queue_packet_commands (peer, channelID, compressedPacket, fragmentLength, commandFlags | ENET_PROTOCOL_COMMAND_FLAG_COMPRESSED) < 0)
+   {
+      /* the caller keeps ownership of the original packet on failure */
+      compressedPacket -> freeCallback = NULL;
+
+      -- packet -> referenceCount;
+
+      enet_packet_destroy (compressedPacket);
+
+      return -1;
+   }
+
+   enet_lz_stream_commit (channel -> outgoingStream, packet -> dataLength);
+
+   return 0;
+}
+
+/* An aggregate of coalesced packets, allocated in one block along with its data. It holds a
+   reference to each packet it copied until it is destroyed, so those are released exactly as
+   if they had been queued themselves. */
+typedef struct _ENetCoalescedPacket
+{
+   ENetPacket   packet;
+   size_t       packetCount;
+   ENetPacket * packets [ENET_PEER_COALESCE_MAXIMUM_PACKETS];
+} ENetCoalescedPacket;
+
+enum
+{
+   ENET_PEER_COALESCE_FLAGS = ENET_PACKET_FLAG_RELIABLE | ENET_PACKET_FLAG_UNSEQUENCED | ENET_PACKET_FLAG_NO_COMPRESS
+};
+
+static void
+enet_peer_release_coalesced_packets (ENetPacket * packet)
+{
+   ENetCoalescedPacket * coalescedPacket = (ENetCoalescedPacket *) packet;
+   size_t packetIndex;
+
+   for (packetIndex = 0; packetIndex < coalescedPacket -> packetCount; ++ packetIndex)
+   {
+      ENetPacket * originalPacket = coalescedPacket -> packets [packetIndex];
+
+      -- originalPacket -> referenceCount;
+
+      if (originalPacket -> referenceCount == 0)
+      {
+         originalPacket -> flags |= packet -> flags & ENET_PACKET_FLAG_SENT;
+
+         enet_packet_destroy (originalPacket);
+      }
+   }
+}
+
+static ENetPacket *
+enet_peer_create_coalesced_packet (size_t limit, enet_uint32 flags)
+{
+   ENetCoalescedPacket * coalescedPacket = (ENetCoalescedPacket *) enet_malloc (sizeof (ENetCoalescedPacket) + limit);
+   ENetPacket * packet;
+
+   if (coalescedPacket == NULL)
+     return NULL;
+
+   coalescedPacket -> packetCount = 0;
+
+   packet = & coalescedPacket -> packet;
+   packet -> referenceCount = 0;
+   packet -> flags = flags | ENET_PACKET_FLAG_NO_ALLOCATE;
+   packet -> data = (enet_uint8 *) (coalescedPacket + 1);
+   packet -> dataLength = 0;
+   packet -> freeCallback = enet_peer_release_coalesced_packets;
+   packet -> userData = NULL;
+   packet -> pool = NULL;
+   packet -> capacity = limit;
+   packet -> segments = NULL;
+   packet -> segmentCount = 0;
+   packet -> deadline = 0;
+
+   return packet;
+}
+
+/* Queues the pending aggregate of a channel, which stays pending on failure. */
+static int
+enet_peer_queue_coalesced_packet (ENetPeer * peer, ENetChannel * channel)
+{
+   if (enet_peer_queue_compressible_packet (peer, (enet_uint8) (channel - peer -> channels), channel -> coalescedPacket,
+         enet_peer_fragment_length (peer), ENET_PROTOCOL_COMMAND_FLAG_AGGREGATE) < 0)
+     return -1;
+
+   channel -> coalescedPacket = NULL;
+
+   -- peer -> coalescedChannels;
+
+   return 0;
+}
+
+static int
+enet_peer_coalesce_packet (ENetPeer * peer, ENetChannel * channel, ENetPacket * packet, size_t limit)
+{
+   ENetCoalescedPacket * coalescedPacket = (ENetCoalescedPacket *) channel -> coalescedPacket;
+   enet_uint8 prefix [5];
+   size_t prefixLength = enet_protocol_write_varint (prefix, (enet_uint32) packet -> dataLength);
+
+   if (coalescedPacket != NULL &&
+       (((coalescedPacket -> packet.flags ^ packet -> flags) & ENET_PEER_COALESCE_FLAGS) ||
+        coalescedPacket -> packet.dataLength + prefixLength + packet -> dataLength > coalescedPacket -> packet.capacity ||
+        coalescedPacket -> packetCount >= ENET_PEER_COALESCE_MAXIMUM_PACKETS))
+   {
+      if (enet_peer_queue_coalesced_packet (peer, channel) < 0)
+        return -1;
+
+      coalescedPacket = NULL;
+   }
+
+   if (coalescedPacket == NULL)
+   {
+      coalescedPacket = (ENetCoalescedPacket *) enet_peer_create_coalesced_packet (limit, packet -> flags & ENET_PEER_COALESCE_FLAGS);
+      if (coalescedPacket == NULL)
+        return -1;
+
+      channel -> coalescedPacket = & coalescedPacket -> packet;
+      channel -> coalescedTime = enet_time_get ();
+
+      ++ peer -> coalescedChannels;
+   }
+
+   memcpy (& coalescedPacket -> packet.data [coalescedPacket -> packet.dataLength], prefix, prefixLength);
+   coalescedPacket -> packet.dataLength += prefixLength;
+
+   memcpy (& coalescedPacket -> packet.data [coalescedPacket -> packet.dataLength], packet -> data, packet -> dataLength);
+   coalescedPacket -> packet.dataLength += packet -> dataLength;
+
+   coalescedPacket -> packets [coalescedPacket -> packetCount ++] = packet;
+
+   ++ packet -> referenceCount;
+
+   return 0;
+}
+
+/** Queues the aggregates of coalesced packets of a peer that have waited at least the given delay.
+    @param peer peer to flush
+    @param delay minimum time in milliseconds since the first packet was added to an aggregate, or 0 to queue all of them
+*/
+void
+enet_peer_flush_coalesced_packets (ENetPeer * peer, enet_uint32 delay)
+{
+   ENetChannel * channel;
+
+   for (channel = peer -> channels;
+        channel < & peer -> channels [peer -> channelCount] && peer -> coalescedChannels > 0;
+        ++ channel)
+   {
+      if (channel -> coalescedPacket != NULL &&
+          (delay == 0 || ENET_TIME_GREATER_EQUAL (peer -> host -> serviceTime, channel -> coalescedTime + delay)))
+        enet_peer_queue_coalesced_packet (peer, channel);
+   }
+}
+
+/** Queues a packet that has already been validated for the peer, fragmenting it into
+    pieces of at most fragmentLength bytes as returned by enet_peer_fragment_length().
+    Small packets are coalesced if the peer agreed to it, and reliable packets are stream
+    compressed if the peer agreed to it.
+*/
+int
+enet_peer_queue_packet (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet, size_t fragmentLength)
+{
+   ENetChannel * channel = & peer -> channels [channelID];
+   size_t coalesceLimit = ENET_MIN (peer -> host -> coalesceLimit, fragmentLength);
+
+   if (peer -> protocolFeatures & ENET_PROTOCOL_FEATURE_COALESCING &&
+       coalesceLimit > 0 &&
+       packet -> dataLength <= coalesceLimit / 4 &&
+       packet -> segments == NULL &&
+       ! (packet -> flags & ENET_PACKET_FLAG_DEADLINE))
+     return enet_peer_coalesce_packet (peer, channel, packet, coalesceLimit);
+
+   if (channel -> coalescedPacket != NULL &&
+       enet_peer_queue_coalesced_packet (peer, channel) < 0)
+     return -1;
+
+   return enet_peer_queue_compressible_packet (peer, channelID, packet, fragmentLength, 0);
+}
+
+/** Queues a packet to be sent as the latest value of a slot, superseding the previous value if it has not been sent yet.
+
+    If a packet sent to the same slot of the channel is still queued and has not been transmitted
+    even once, the new packet takes its place in the queue and the old one is released without being
+    sent, so a congested peer holds at most one pending packet per slot rather than a backlog of
+    stale values. This applies to reliable packets too, since a reliable packet that was never
+    transmitted can still be replaced without the peer noticing. The new packet only takes the old
+    one's place if it is sent the same way, reliably, unreliably or unsequenced, and fits in a single
+    command; otherwise an unsent unreliable or unsequenced old value is dropped, an unsent reliable
+    one is still delivered, and the new packet is queued at the end as with enet_peer_send().
+    Packets sent to a slot are never stream compressed.
+
+    @param peer destination for the packet
+    @param channelID channel on which to send
+    @param slot key identifying the value within the channel
+    @param packet packet to send
+    @retval 0 on success
+    @retval < 0 on failure
+*/
+int
+enet_peer_send_slot (ENetPeer * peer, enet_uint8 channelID, enet_uint16 slot, ENetPacket * packet)
+{
+   ENetChannel * channel;
+   ENetOutgoingCommand * outgoingCommand;
+   ENetProtocol command;
+
+   if (peer -> state != ENET_PEER_STATE_CONNECTED ||
+       channelID >= peer -> channelCount ||
+       packet -> dataLength > peer -> host -> maximumPacketSize)
+     return -1;
+
+   channel = & peer -> channels [channelID];
+
+   if (channel -> coalescedPacket != NULL &&
+       enet_peer_queue_coalesced_packet (peer, channel) < 0)
      return -1;
 
+   command.header.channelID = channelID;
+   enet_peer_setup_packet_command (channel, packet, 0, & command);
+
+   outgoingCommand = (ENetOutgoingCommand *) enet_sequence_table_find (channel -> outgoingSlotTable, slot);
+   if (outgoingCommand != NULL)
+   {
+      if (packet -> dataLength <= enet_peer_fragment_length (peer) &&
+          outgoingCommand -> command.header.command == command.header.command)
+      {
+         switch (command.header.command & ENET_PROTOCOL_COMMAND_MASK)
+         {
+         case ENET_PROTOCOL_COMMAND_SEND_RELIABLE:
+            outgoingCommand -> command.sendReliable.dataLength = command.sendReliable.dataLength;
+            break;
+
+         case ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE:
+            outgoingCommand -> command.sendUnreliable.dataLength = command.sendUnreliable.dataLength;
+            break;
+
+         default:
+            outgoingCommand -> command.sendUnsequenced.dataLength = command.sendUnsequenced.dataLength;
+            break;
+         }
+
+         peer -> outgoingDataTotal += packet -> dataLength - outgoingCommand -> fragmentLength;
+
+         outgoingCommand -> fragmentLength = packet -> dataLength;
+
+         ++ packet -> referenceCount;
+
+         -- outgoingCommand -> packet -> referenceCount;
+
+         if (outgoingCommand -> packet -> referenceCount == 0)
+           enet_packet_destroy (outgoingCommand -> packet);
+
+         outgoingCommand -> packet = packet;
+
+         return 0;
+      }
+
+      enet_peer_clear_slot (peer, outgoingCommand);
+
+      if (! (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE))
+      {
+         enet_list_remove (& outgoingCommand -> outgoingCommandList);
+
+         -- outgoingCommand -> packet -> referenceCount;
+
+         if (outgoingCommand -> packet -> referenceCount == 0)
+           enet_packet_destroy (outgoingCommand -> packet);
+
+         enet_object_pool_free (& peer -> host -> outgoingCommandPool, outgoingCommand);
+      }
+   }
+
+   if (packet -> dataLength > enet_peer_fragment_length (peer))
+     return enet_peer_queue_packet_commands (peer, channelID, packet, enet_peer_fragment_length (peer), 0);
+
+   if (enet_sequence_table_reserve (& channel -> outgoingSlotTable, slot) < 0)
+     return -1;
+
+   outgoingCommand = enet_peer_queue_outgoing_command (peer, & command, packet, 0, packet -> dataLength);
+   if (outgoingCommand == NULL)
+     return -1;
+
+   outgoingCommand -> slot = slot;
+   outgoingCommand -> slotted = 1;
+
+   enet_sequence_table_insert (channel -> outgoingSlotTable, slot, outgoingCommand);
+
+   return 0;
+}
+
+/** Removes a command from the slot it was sent to once it can no longer be superseded,
+    because it has been transmitted or dropped.
+    @param peer peer the command was queued on
+    @param outgoingCommand command queued by enet_peer_send_slot()
+*/
+void
+enet_peer_clear_slot (ENetPeer * peer, ENetOutgoingCommand * outgoingCommand)
+{
+   if (! outgoingCommand -> slotted)
+     return;
+
+   enet_sequence_table_remove (peer -> channels [outgoingCommand -> command.header.channelID].outgoingSlotTable, outgoingCommand -> slot);
+
+   outgoingCommand -> slotted = 0;
+}
+
+static void
+enet_peer_free_incoming_command (ENetPeer * peer, ENetIncomingCommand * incomingCommand)
+{
+    if (incomingCommand -> packet != NULL)
+    {
+       -- incomingCommand -> packet -> referenceCount;
+
+       if (incomingCommand -> packet -> referenceCount == 0)
+         enet_packet_destroy (incomingCommand -> packet);
+    }
+
+    if (incomingCommand -> fragments != NULL)
+      enet_free (incomingCommand -> fragments);
+
+    enet_object_pool_free (& peer -> host -> incomingCommandPool, incomingCommand);
+}
+
+/** Replaces the packet of a stream compressed command with its decompressed contents.
+    Once a packet fails to decompress the histories of both ends no longer agree, so the
+    caller must fail the peer rather than deliver any later packets of the channel.
+*/
+static int
+enet_peer_decompress_packet (ENetPeer * peer, ENetChannel * channel, ENetIncomingCommand * incomingCommand)
+{
+    ENetPacket * packet = incomingCommand -> packet, * decompressedPacket;
+    const enet_uint8 * data;
+    size_t dataLength;
+
+    if (! (peer -> protocolFeatures & ENET_PROTOCOL_FEATURE_STREAM_COMPRESSION) ||
+        packet -> dataLength <= sizeof (enet_uint16))
+      return -1;
+
+    if (channel -> incomingStream == NULL)
+    {
+       channel -> incomingStream = enet_lz_stream_create (0);
+       if (channel -> incomingStream == NULL)
+         return -1;
+    }
+
+    dataLength = ((size_t) packet -> data [0] << 8) | packet -> data [1];
+    data = enet_lz_stream_decompress (channel -> incomingStream, packet -> data + sizeof (enet_uint16), packet -> dataLength - sizeof (enet_uint16), dataLength);
+    if (data == NULL)
+      return -1;
+
+    if (incomingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_AGGREGATE)
+      decompressedPacket = enet_host_packet_create (peer -> host, data, dataLength, packet -> flags);
+    else
+      decompressedPacket = enet_packet_create (data, dataLength, packet -> flags);
+    if (decompressedPacket == NULL)
+      return -1;
+
+    enet_lz_stream_commit (channel -> incomingStream, dataLength);
+
+    peer -> totalWaitingData += dataLength;
+    peer -> totalWaitingData -= packet -> dataLength;
+
+    ++ decompressedPacket -> referenceCount;
+
+    -- packet -> referenceCount;
+
+    if (packet -> referenceCount == 0)
+      enet_packet_destroy (packet);
+
+    incomingCommand -> packet = decompressedPacket;
+    incomingCommand -> command.header.command &= ~ ENET_PROTOCOL_COMMAND_FLAG_COMPRESSED;
+
+    return 0;
+}
+
+/** Replaces an aggregate command that was dispatched with one command for each packet coalesced
+    into it. Nothing is replaced if the aggregate is malformed or memory runs out part way through.
+*/
+static int
+enet_peer_unpack_aggregate (ENetPeer * peer, ENetIncomingCommand * aggregate)
+{
+   ENetPacket * packet = aggregate -> packet;
+   const enet_uint8 * data = packet -> data,
+                    * dataEnd = & packet -> data [packet -> dataLength];
+   ENetListIterator position = enet_list_next (& aggregate -> incomingCommandList);
+   enet_uint32 length;
+
+   while (data < dataEnd)
+   {
+      if (enet_protocol_read_varint (& data, dataEnd, & length) < 0 ||
+          length > (size_t) (dataEnd - data))
+        return -1;
+
+      data += length;
+   }
+
+   for (data = packet -> data; data < dataEnd; data += length)
+   {
+      ENetIncomingCommand * incomingCommand;
+      ENetPacket * coalescedPacket;
+
+      enet_protocol_read_varint (& data, dataEnd, & length);
+
+      coalescedPacket = enet_packet_create (data, length, packet -> flags);
+      if (coalescedPacket == NULL)
+        goto unpackError;
+
+      incomingCommand = (ENetIncomingCommand *) enet_object_pool_allocate (& peer -> host -> incomingCommandPool);
+      if (incomingCommand == NULL)
+      {
+         enet_packet_destroy (coalescedPacket);
+
+         goto unpackError;
+      }
+
+      incomingCommand -> reliableSequenceNumber = aggregate -> reliableSequenceNumber;
+      incomingCommand -> unreliableSequenceNumber = aggregate -> unreliableSequenceNumber;
+      incomingCommand -> command = aggregate -> command;
+      incomingCommand -> command.header.command &= ~ ENET_PROTOCOL_COMMAND_FLAG_AGGREGATE;
+      incomingCommand -> fragmentCount = 0;
+      incomingCommand -> fragmentsRemaining = 0;
+      incomingCommand -> fragments = NULL;
+      incomingCommand -> packet = coalescedPacket;
+
+      ++ coalescedPacket -> referenceCount;
+
+      enet_list_insert (position, incomingCommand);
+
+      peer -> totalWaitingData += length;
+   }
+
+   enet_list_remove (& aggregate -> incomingCommandList);
+
+   peer -> totalWaitingData -= packet -> dataLength;
+
+   enet_peer_free_incoming_command (peer, aggregate);
+
    return 0;
+
+unpackError:
+   while (enet_list_next (& aggregate -> incomingCommandList) != position)
+   {
+      ENetIncomingCommand * incomingCommand = (ENetIncomingCommand *) enet_list_remove (enet_list_next (& aggregate -> incomingCommandList));
+
+      peer -> totalWaitingData -= incomingCommand -> packet -> dataLength;
+
+      enet_peer_free_incoming_command (peer, incomingCommand);
+   }
+
+   return -1;
 }
 
 /** Attempts to dequeue any incoming queued packet.
     @param peer peer to dequeue packets from
     @param channelID holds the channel ID of the channel the packet was received on success
     @returns a pointer to the packet, or NULL if there are no available incoming queued packets
+    @remarks NULL is also returned while packets are still queued if a stream compressed packet
+    could not be decompressed or an aggregate of coalesced packets could not be unpacked, in which
+    case the peer can no longer deliver its packets in order and enet_host_service() disconnects it.
 */
 ENetPacket *
 enet_peer_receive (ENetPeer * peer, enet_uint8 * channelID)
@@ -224,10 +808,24 @@ enet_peer_receive (ENetPeer * peer, enet_uint8 * channelID)
    ENetIncomingCommand * incomingCommand;
    ENetPacket * packet;
 
-   if (enet_list_empty (& peer -> dispatchedCommands))
-     return NULL;
+   for (;;)
+   {
+      if (enet_list_empty (& peer -> dispatchedCommands))
+        return NULL;
+
+      incomingCommand = (ENetIncomingCommand *) enet_list_front (& peer -> dispatchedCommands);
+      if (incomingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_COMPRESSED &&
+          enet_peer_decompress_packet (peer, & peer -> channels [incomingCommand -> command.header.channelID], incomingCommand) < 0)
+        return NULL;
+
+      if (! (incomingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_AGGREGATE))
+        break;
 
-   incomingCommand = (ENetIncomingCommand *) enet_list_remove (enet_list_begin (& peer -> dispatchedCommands));
+      if (enet_peer_unpack_aggregate (peer, incomingCommand) < 0)
+        return NULL;
+   }
+
+   enet_list_remove (& incomingCommand -> incomingCommandList);
 
    if (channelID != NULL)
      * channelID = incomingCommand -> command.header.channelID;
@@ -239,7 +837,7 @@ enet_peer_receive (ENetPeer * peer, enet_uint8 * channelID)
    if (incomingCommand -> fragments != NULL)
      enet_free (incomingCommand -> fragments);
 
-   enet_free (incomingCommand);
+   enet_object_pool_free (& peer -> host -> incomingCommandPool, incomingCommand);
 
    peer -> totalWaitingData -= packet -> dataLength;
 
@@ -247,7 +845,7 @@ enet_peer_receive (ENetPeer * peer, enet_uint8 * channelID)
 }
 
 static void
-enet_peer_reset_outgoing_commands (ENetList * queue)
+enet_peer_reset_outgoing_commands (ENetPeer * peer, ENetList * queue)
 {
     ENetOutgoingCommand * outgoingCommand;
 
@@ -263,12 +861,12 @@ enet_peer_reset_outgoing_commands (ENetList * queue)
             enet_packet_destroy (outgoingCommand -> packet);
        }
 
-       enet_free (outgoingCommand);
+       enet_object_pool_free (& peer -> host -> outgoingCommandPool, outgoingCommand);
     }
 }
 
 static void
-enet_peer_remove_incoming_commands (ENetList * queue, ENetListIterator startCommand, ENetListIterator endCommand)
+enet_peer_remove_incoming_commands (ENetPeer * peer, ENetList * queue, ENetListIterator startCommand, ENetListIterator endCommand)
 {
     ENetListIterator currentCommand;
 
@@ -280,31 +878,21 @@ enet_peer_remove_incoming_commands (ENetList * queue, ENetListIterator startComm
 
        enet_list_remove (& incomingCommand -> incomingCommandList);
 
-       if (incomingCommand -> packet != NULL)
-       {
-          -- incomingCommand -> packet -> referenceCount;
-
-          if (incomingCommand -> packet -> referenceCount == 0)
-            enet_packet_destroy (incomingCommand -> packet);
-       }
-
-       if (incomingCommand -> fragments != NULL)
-         enet_free (incomingCommand -> fragments);
-
-       enet_free (incomingCommand);
+       enet_peer_free_incoming_command (peer, incomingCommand);
     }
 }
 
 static void
-enet_peer_reset_incoming_commands (ENetList * queue)
+enet_peer_reset_incoming_commands (ENetPeer * peer, ENetList * queue)
 {
-    enet_peer_remove_incoming_commands(queue, enet_list_begin (queue), enet_list_end (queue));
+    enet_peer_remove_incoming_commands(peer, queue, enet_list_begin (queue), enet_list_end (queue));
 }
 
 void
 enet_peer_reset_queues (ENetPeer * peer)
 {
     ENetChannel * channel;
+    size_t priority;
 
     if (peer -> needsDispatch)
     {
@@ -313,14 +901,22 @@ enet_peer_reset_queues (ENetPeer * peer)
        peer -> needsDispatch = 0;
     }
 
+    peer -> dispatchDeficit = 0;
+
     while (! enet_list_empty (& peer -> acknowledgements))
-      enet_free (enet_list_remove (enet_list_begin (& peer -> acknowledgements)));
+      enet_object_pool_free (& peer -> host -> acknowledgementPool, enet_list_remove (enet_list_begin (& peer -> acknowledgements)));
+
+    enet_peer_reset_outgoing_commands (peer, & peer -> sentReliableCommands);
+    enet_peer_reset_outgoing_commands (peer, & peer -> sentUnreliableCommands);
+    enet_peer_reset_outgoing_commands (peer, & peer -> outgoingReliableCommands);
+    enet_peer_reset_outgoing_commands (peer, & peer -> outgoingUnreliableCommands);
+    enet_peer_reset_incoming_commands (peer, & peer -> dispatchedCommands);
 
-    enet_peer_reset_outgoing_commands (& peer -> sentReliableCommands);
-    enet_peer_reset_outgoing_commands (& peer -> sentUnreliableCommands);
-    enet_peer_reset_outgoing_commands (& peer -> outgoingReliableCommands);
-    enet_peer_reset_outgoing_commands (& peer -> outgoingUnreliableCommands);
-    enet_peer_reset_incoming_commands (& peer -> dispatchedCommands);
+    enet_sequence_table_destroy (peer -> sentReliableTable);
+    peer -> sentReliableTable = NULL;
+
+    for (priority = 0; priority < ENET_PEER_CHANNEL_PRIORITIES; ++ priority)
+      enet_list_clear (& peer -> sendQueues [priority]);
 
     if (peer -> channels != NULL && peer -> channelCount > 0)
     {
@@ -328,8 +924,20 @@ enet_peer_reset_queues (ENetPeer * peer)
              channel < & peer -> channels [peer -> channelCount];
              ++ channel)
         {
-            enet_peer_reset_incoming_commands (& channel -> incomingReliableCommands);
-            enet_peer_reset_incoming_commands (& channel -> incomingUnreliableCommands);
+            enet_peer_reset_outgoing_commands (peer, & channel -> outgoingReliableCommands);
+            enet_peer_reset_outgoing_commands (peer, & channel -> outgoingUnreliableCommands);
+            enet_peer_reset_incoming_commands (peer, & channel -> incomingReliableCommands);
+            enet_peer_reset_incoming_commands (peer, & channel -> incomingUnreliableCommands);
+
+            enet_sequence_table_destroy (channel -> incomingReliableTable);
+            enet_sequence_table_destroy (channel -> sentReliableTable);
+            enet_sequence_table_destroy (channel -> outgoingSlotTable);
+
+            enet_lz_stream_destroy (channel -> outgoingStream);
+            enet_lz_stream_destroy (channel -> incomingStream);
+
+            if (channel -> coalescedPacket != NULL)
+              enet_packet_destroy (channel -> coalescedPacket);
         }
 
         enet_free (peer -> channels);
@@ -337,6 +945,7 @@ enet_peer_reset_queues (ENetPeer * peer)
 
     peer -> channels = NULL;
     peer -> channelCount = 0;
+    peer -> coalescedChannels = 0;
 }
 
 void
@@ -391,6 +1000,7 @@ enet_peer_reset (ENetPeer * peer)
     peer -> packetLossEpoch = 0;
     peer -> packetsSent = 0;
     peer -> packetsLost = 0;
+    peer -> packetsExpired = 0;
     peer -> packetLoss = 0;
     peer -> packetLossVariance = 0;
     peer -> packetThrottle = ENET_PEER_DEFAULT_PACKET_THROTTLE;
@@ -404,6 +1014,8 @@ enet_peer_reset (ENetPeer * peer)
     peer -> timeoutLimit = ENET_PEER_TIMEOUT_LIMIT;
     peer -> timeoutMinimum = ENET_PEER_TIMEOUT_MINIMUM;
     peer -> timeoutMaximum = ENET_PEER_TIMEOUT_MAXIMUM;
+    peer -> dispatchPriority = ENET_PEER_DISPATCH_PRIORITY;
+    peer -> dispatchQuantum = ENET_PEER_DISPATCH_QUANTUM;
     peer -> lastRoundTripTime = ENET_PEER_DEFAULT_ROUND_TRIP_TIME;
     peer -> lowestRoundTripTime = ENET_PEER_DEFAULT_ROUND_TRIP_TIME;
     peer -> lastRoundTripTimeVariance = 0;
@@ -418,6 +1030,10 @@ enet_peer_reset (ENetPeer * peer)
     peer -> outgoingUnsequencedGroup = 0;
     peer -> eventData = 0;
     peer -> totalWaitingData = 0;
+    peer -> compressionRatio = 0;
+    peer -> compressionBackoff = 0;
+    peer -> compressionSkip = 0;
+    peer -> protocolFeatures = 0;
 
     memset (peer -> unsequencedWindow, 0, sizeof (peer -> unsequencedWindow));
 
@@ -485,6 +1101,159 @@ enet_peer_timeout (ENetPeer * peer, enet_uint32 timeoutLimit, enet_uint32 timeou
     peer -> timeoutMaximum = timeoutMaximum ? timeoutMaximum : ENET_PEER_TIMEOUT_MAXIMUM;
 }
 
+/** Sets how received packets of a peer are scheduled by enet_host_service() against those of other peers.
+
+    Peers waiting to dispatch events are served strictly by priority class, so peers in a class
+    only get to dispatch once no peer in a lower class has anything waiting. Within a class, peers
+    take turns in deficit round robin order: each turn a peer may dispatch as many bytes of
+    received packets as its quantum, plus whatever it left unused in earlier turns, so a peer
+    flooding small packets gets no larger a share than one sending large packets, and a peer
+    with twice the quantum gets twice the share.
+
+    @param peer the peer to adjust
+    @param priority the priority class, less than ENET_PEER_DISPATCH_PRIORITIES; defaults to ENET_PEER_DISPATCH_PRIORITY if out of range
+    @param quantum the bytes of received packets dispatched per turn; defaults to ENET_PEER_DISPATCH_QUANTUM if 0
+*/
+void
+enet_peer_dispatch_configure (ENetPeer * peer, enet_uint32 priority, enet_uint32 quantum)
+{
+    if (priority >= ENET_PEER_DISPATCH_PRIORITIES)
+      priority = ENET_PEER_DISPATCH_PRIORITY;
+
+    peer -> dispatchQuantum = quantum ? quantum : ENET_PEER_DISPATCH_QUANTUM;
+
+    if (priority != peer -> dispatchPriority)
+    {
+       peer -> dispatchPriority = priority;
+
+       if (peer -> needsDispatch)
+       {
+          enet_list_remove (& peer -> dispatchList);
+
+          enet_list_insert (enet_list_end (& peer -> host -> dispatchQueues [priority]), & peer -> dispatchList);
+       }
+    }
+}
+
+/** Sets how outgoing commands of a channel of a peer are scheduled against those of its other channels.
+
+    Commands sent outside of any channel, such as pings and disconnects, always go first. Datagrams
+    are then filled strictly by priority class, so channels in a class only get to send once no
+    channel in a lower class has anything it may send. Within a class, channels take turns in
+    deficit round robin order: each turn a channel may send its weight times the peer MTU in bytes,
+    so a bulk transfer on one channel does not delay traffic on the others by more than its share.
+    Commands within a channel are always sent in order.
+
+    @param peer the peer to adjust
+    @param channelID the channel to adjust
+    @param priority the priority class, less than ENET_PEER_CHANNEL_PRIORITIES; defaults to ENET_PEER_CHANNEL_PRIORITY if out of range
+    @param weight the share of the channel within its class, at most ENET_PEER_CHANNEL_WEIGHT_MAXIMUM; defaults to ENET_PEER_CHANNEL_WEIGHT if 0
+    @retval 0 on success
+    @retval < 0 if the peer has no such channel
+*/
+int
+enet_peer_channel_configure (ENetPeer * peer, enet_uint8 channelID, enet_uint32 priority, enet_uint32 weight)
+{
+    ENetChannel * channel;
+
+    if (channelID >= peer -> channelCount)
+      return -1;
+
+    channel = & peer -> channels [channelID];
+
+    if (priority >= ENET_PEER_CHANNEL_PRIORITIES)
+      priority = ENET_PEER_CHANNEL_PRIORITY;
+
+    if (weight == 0)
+      weight = ENET_PEER_CHANNEL_WEIGHT;
+    else
+    if (weight > ENET_PEER_CHANNEL_WEIGHT_MAXIMUM)
+      weight = ENET_PEER_CHANNEL_WEIGHT_MAXIMUM;
+
+    channel -> sendWeight = weight;
+
+    if (priority != channel -> sendPriority)
+    {
+       channel -> sendPriority = priority;
+
+       if (channel -> needsSend)
+       {
+          enet_list_remove (& channel -> sendList);
+
+          enet_list_insert (enet_list_end (& peer -> sendQueues [priority]), & channel -> sendList);
+       }
+    }
+
+    return 0;
+}
+
+/** Retrieves the statistics of a peer.
+    @param peer peer to query
+    @param stats receives the statistics
+*/
+void
+enet_peer_get_stats (const ENetPeer * peer, ENetStats * stats)
+{
+    * stats = peer -> stats;
+}
+
+/** Queues a channel on the send queue of its priority class unless it is already waiting.
+    @param peer the peer the channel belongs to
+    @param channel the channel that has outgoing commands
+*/
+void
+enet_peer_queue_channel (ENetPeer * peer, ENetChannel * channel)
+{
+    if (channel -> needsSend)
+      return;
+
+    enet_list_insert (enet_list_end (& peer -> sendQueues [channel -> sendPriority]), & channel -> sendList);
+
+    channel -> needsSend = 1;
+    channel -> sendDeficit = channel -> sendWeight * peer -> mtu;
+}
+
+/** Checks whether a peer still has commands waiting to be sent or acknowledged.
+    @param peer the peer to check
+*/
+int
+enet_peer_has_outgoing_commands (ENetPeer * peer)
+{
+    ENetChannel * channel;
+
+    if (! enet_list_empty (& peer -> outgoingReliableCommands) ||
+        ! enet_list_empty (& peer -> outgoingUnreliableCommands) ||
+        ! enet_list_empty (& peer -> sentReliableCommands) ||
+        peer -> coalescedChannels > 0)
+      return 1;
+
+    for (channel = peer -> channels;
+         channel < & peer -> channels [peer -> channelCount];
+         ++ channel)
+    {
+       if (! enet_list_empty (& channel -> outgoingReliableCommands) ||
+           ! enet_list_empty (& channel -> outgoingUnreliableCommands))
+         return 1;
+    }
+
+    return 0;
+}
+
+/** Queues a peer on the dispatch queue of its priority class, starting its first turn, unless it is already waiting.
+    @param peer the peer that has events to dispatch
+*/
+void
+enet_peer_queue_dispatch (ENetPeer * peer)
+{
+    if (peer -> needsDispatch)
+      return;
+
+    enet_list_insert (enet_list_end (& peer -> host -> dispatchQueues [peer -> dispatchPriority]), & peer -> dispatchList);
+
+    peer -> needsDispatch = 1;
+    peer -> dispatchDeficit = peer -> dispatchQuantum;
+}
+
 /** Force an immediate disconnection from a peer.
     @param peer peer to disconnect
     @param data data describing the disconnection
@@ -569,10 +1338,11 @@ enet_peer_disconnect (ENetPeer * peer, enet_uint32 data)
 void
 enet_peer_disconnect_later (ENetPeer * peer, enet_uint32 data)
 {
+    if (peer -> coalescedChannels > 0)
+      enet_peer_flush_coalesced_packets (peer, 0);
+
     if ((peer -> state == ENET_PEER_STATE_CONNECTED || peer -> state == ENET_PEER_STATE_DISCONNECT_LATER) &&
-        ! (enet_list_empty (& peer -> outgoingReliableCommands) &&
-           enet_list_empty (& peer -> outgoingUnreliableCommands) &&
-           enet_list_empty (& peer -> sentReliableCommands)))
+        enet_peer_has_outgoing_commands (peer))
     {
         peer -> state = ENET_PEER_STATE_DISCONNECT_LATER;
         peer -> eventData = data;
@@ -599,7 +1369,7 @@ enet_peer_queue_acknowledgement (ENetPeer * peer, const ENetProtocol * command,
           return NULL;
     }
 
-    acknowledgement = (ENetAcknowledgement *) enet_malloc (sizeof (ENetAcknowledgement));
+    acknowledgement = (ENetAcknowledgement *) enet_object_pool_allocate (& peer -> host -> acknowledgementPool);
     if (acknowledgement == NULL)
       return NULL;
 
@@ -635,6 +1405,15 @@ enet_peer_setup_outgoing_command (ENetPeer * peer, ENetOutgoingCommand * outgoin
 
        outgoingCommand -> reliableSequenceNumber = channel -> outgoingReliableSequenceNumber;
        outgoingCommand -> unreliableSequenceNumber = 0;
+
+       if (outgoingCommand -> fragmentsRemaining > 1)
+       {
+          /* reserve sequence numbers for the fragments the transfer will split off later */
+          channel -> outgoingReliableSequenceNumber += outgoingCommand -> fragmentsRemaining - 1;
+
+          peer -> outgoingDataTotal += (outgoingCommand -> fragmentsRemaining - 1) * enet_protocol_command_size (outgoingCommand -> command.header.command) +
+                                        outgoingCommand -> packet -> dataLength - outgoingCommand -> fragmentLength;
+       }
     }
     else
     if (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_UNSEQUENCED)
@@ -654,6 +1433,8 @@ enet_peer_setup_outgoing_command (ENetPeer * peer, ENetOutgoingCommand * outgoin
     }
 
     outgoingCommand -> sendAttempts = 0;
+    outgoingCommand -> inTransit = 0;
+    outgoingCommand -> slotted = 0;
     outgoingCommand -> sentTime = 0;
     outgoingCommand -> roundTripTimeout = 0;
     outgoingCommand -> roundTripTimeoutLimit = 0;
@@ -673,22 +1454,37 @@ enet_peer_setup_outgoing_command (ENetPeer * peer, ENetOutgoingCommand * outgoin
         break;
     }
 
+    ENET_PROBE5 (command__queue, peer, outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK, outgoingCommand -> command.header.channelID, outgoingCommand -> reliableSequenceNumber, outgoingCommand -> fragmentLength);
+
+    if (outgoingCommand -> command.header.channelID >= peer -> channelCount)
+    {
+       if (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE)
+         enet_list_insert (enet_list_end (& peer -> outgoingReliableCommands), outgoingCommand);
+       else
+         enet_list_insert (enet_list_end (& peer -> outgoingUnreliableCommands), outgoingCommand);
+
+       return;
+    }
+
     if (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE)
-      enet_list_insert (enet_list_end (& peer -> outgoingReliableCommands), outgoingCommand);
+      enet_list_insert (enet_list_end (& channel -> outgoingReliableCommands), outgoingCommand);
     else
-      enet_list_insert (enet_list_end (& peer -> outgoingUnreliableCommands), outgoingCommand);
+      enet_list_insert (enet_list_end (& channel -> outgoingUnreliableCommands), outgoingCommand);
+
+    enet_peer_queue_channel (peer, channel);
 }
 
 ENetOutgoingCommand *
 enet_peer_queue_outgoing_command (ENetPeer * peer, const ENetProtocol * command, ENetPacket * packet, enet_uint32 offset, enet_uint16 length)
 {
-    ENetOutgoingCommand * outgoingCommand = (ENetOutgoingCommand *) enet_malloc (sizeof (ENetOutgoingCommand));
+    ENetOutgoingCommand * outgoingCommand = (ENetOutgoingCommand *) enet_object_pool_allocate (& peer -> host -> outgoingCommandPool);
     if (outgoingCommand == NULL)
       return NULL;
 
     outgoingCommand -> command = * command;
     outgoingCommand -> fragmentOffset = offset;
     outgoingCommand -> fragmentLength = length;
+    outgoingCommand -> fragmentsRemaining = 0;
     outgoingCommand -> packet = packet;
     if (packet != NULL)
       ++ packet -> referenceCount;
@@ -698,6 +1494,47 @@ enet_peer_queue_outgoing_command (ENetPeer * peer, const ENetProtocol * command,
     return outgoingCommand;
 }
 
+/** Splits the next fragment off a reliable fragment transfer so that it can be sent.
+    The fragment is inserted ahead of the transfer in the outgoing reliable queue and
+    the transfer advances to describe the following fragment.
+    @param peer peer the transfer is queued on
+    @param transfer transfer command with more than one fragment remaining
+    @returns the split off fragment on success, NULL on failure
+*/
+ENetOutgoingCommand *
+enet_peer_split_outgoing_fragment (ENetPeer * peer, ENetOutgoingCommand * transfer)
+{
+    ENetOutgoingCommand * fragment = (ENetOutgoingCommand *) enet_object_pool_allocate (& peer -> host -> outgoingCommandPool);
+    enet_uint32 fragmentOffset, fragmentLength;
+
+    if (fragment == NULL)
+      return NULL;
+
+    * fragment = * transfer;
+    fragment -> fragmentsRemaining = 0;
+
+    ++ fragment -> packet -> referenceCount;
+
+    enet_list_insert (& transfer -> outgoingCommandList, fragment);
+
+    fragmentOffset = transfer -> fragmentOffset + transfer -> fragmentLength;
+    fragmentLength = transfer -> fragmentLength;
+    if (transfer -> packet -> dataLength - fragmentOffset < fragmentLength)
+      fragmentLength = transfer -> packet -> dataLength - fragmentOffset;
+
+    -- transfer -> fragmentsRemaining;
+    ++ transfer -> reliableSequenceNumber;
+
+    transfer -> fragmentOffset = fragmentOffset;
+    transfer -> fragmentLength = fragmentLength;
+    transfer -> command.header.reliableSequenceNumber = ENET_HOST_TO_NET_16 (transfer -> reliableSequenceNumber);
+    transfer -> command.sendFragment.dataLength = ENET_HOST_TO_NET_16 (fragmentLength);
+    transfer -> command.sendFragment.fragmentNumber = ENET_HOST_TO_NET_32 (ENET_NET_TO_HOST_32 (transfer -> command.sendFragment.fragmentNumber) + 1);
+    transfer -> command.sendFragment.fragmentOffset = ENET_HOST_TO_NET_32 (fragmentOffset);
+
+    return fragment;
+}
+
 void
 enet_peer_dispatch_incoming_unreliable_commands (ENetPeer * peer, ENetChannel * channel)
 {
@@ -724,12 +1561,7 @@ enet_peer_dispatch_incoming_unreliable_commands (ENetPeer * peer, ENetChannel *
           {
              enet_list_move (enet_list_end (& peer -> dispatchedCommands), startCommand, enet_list_previous (currentCommand));
 
-             if (! peer -> needsDispatch)
-             {
-                enet_list_insert (enet_list_end (& peer -> host -> dispatchQueue), & peer -> dispatchList);
-
-                peer -> needsDispatch = 1;
-             }
+             enet_peer_queue_dispatch (peer);
 
              droppedCommand = currentCommand;
           }
@@ -752,12 +1584,7 @@ enet_peer_dispatch_incoming_unreliable_commands (ENetPeer * peer, ENetChannel *
           {
              enet_list_move (enet_list_end (& peer -> dispatchedCommands), startCommand, enet_list_previous (currentCommand));
 
-             if (! peer -> needsDispatch)
-             {
-                enet_list_insert (enet_list_end (& peer -> host -> dispatchQueue), & peer -> dispatchList);
-
-                peer -> needsDispatch = 1;
-             }
+             enet_peer_queue_dispatch (peer);
           }
        }
 
@@ -768,56 +1595,150 @@ enet_peer_dispatch_incoming_unreliable_commands (ENetPeer * peer, ENetChannel *
     {
        enet_list_move (enet_list_end (& peer -> dispatchedCommands), startCommand, enet_list_previous (currentCommand));
 
-       if (! peer -> needsDispatch)
-       {
-           enet_list_insert (enet_list_end (& peer -> host -> dispatchQueue), & peer -> dispatchList);
-
-           peer -> needsDispatch = 1;
-       }
+       enet_peer_queue_dispatch (peer);
 
        droppedCommand = currentCommand;
     }
 
-    enet_peer_remove_incoming_commands (& channel -> incomingUnreliableCommands, enet_list_begin (& channel -> incomingUnreliableCommands), droppedCommand);
+    enet_peer_remove_incoming_commands (peer, & channel -> incomingUnreliableCommands, enet_list_begin (& channel -> incomingUnreliableCommands), droppedCommand);
+}
+
+/** Looks up a reliable command waiting on a channel by its reliable sequence number.
+    @returns the command, or NULL if none with that sequence number is waiting
+*/
+ENetIncomingCommand *
+enet_peer_find_incoming_reliable_command (ENetChannel * channel, enet_uint16 reliableSequenceNumber)
+{
+    return (ENetIncomingCommand *) enet_sequence_table_find (channel -> incomingReliableTable, reliableSequenceNumber);
+}
+
+static void
+enet_peer_insert_incoming_reliable_command (ENetChannel * channel, ENetIncomingCommand * incomingCommand)
+{
+    enet_sequence_table_insert (channel -> incomingReliableTable, incomingCommand -> reliableSequenceNumber, incomingCommand);
+
+    enet_list_insert (enet_list_end (& channel -> incomingReliableCommands), incomingCommand);
+}
+
+static void
+enet_peer_remove_incoming_reliable_command (ENetChannel * channel, ENetIncomingCommand * incomingCommand)
+{
+    enet_sequence_table_remove (channel -> incomingReliableTable, incomingCommand -> reliableSequenceNumber);
+
+    enet_list_remove (& incomingCommand -> incomingCommandList);
+}
+
+/** Drops any waiting commands a peer sent with sequence numbers inside the range consumed by a
+    fragmented packet, which would otherwise linger in the table until the sequence numbers wrap.
+*/
+static void
+enet_peer_discard_incoming_reliable_commands (ENetPeer * peer, ENetChannel * channel, enet_uint16 startSequenceNumber, enet_uint32 count)
+{
+    enet_uint32 offset;
+
+    if (count > 0xFFFF)
+      count = 0xFFFF;
+
+    for (offset = 0; offset < count && enet_sequence_table_size (channel -> incomingReliableTable) > 0; ++ offset)
+    {
+       ENetIncomingCommand * incomingCommand = enet_peer_find_incoming_reliable_command (channel, (enet_uint16) (startSequenceNumber + offset));
+       if (incomingCommand == NULL)
+         continue;
+
+       enet_peer_remove_incoming_reliable_command (channel, incomingCommand);
+
+       if (incomingCommand -> packet != NULL)
+         peer -> totalWaitingData -= incomingCommand -> packet -> dataLength;
+
+       enet_peer_free_incoming_command (peer, incomingCommand);
+    }
 }
 
+/** Dispatches the reliable commands of a channel that are next in sequence and complete.
+    @param peer peer the channel belongs to
+    @param channel channel to dispatch from
+    @param queuedCommand a newly arrived command that is next in sequence and complete and that
+    was not inserted into the channel's table, or NULL
+*/
 void
-enet_peer_dispatch_incoming_reliable_commands (ENetPeer * peer, ENetChannel * channel)
+enet_peer_dispatch_incoming_reliable_commands (ENetPeer * peer, ENetChannel * channel, ENetIncomingCommand * queuedCommand)
 {
-    ENetListIterator currentCommand;
+    ENetIncomingCommand * incomingCommand = queuedCommand;
+    int dispatched = 0, advanced = 0;
 
-    for (currentCommand = enet_list_begin (& channel -> incomingReliableCommands);
-         currentCommand != enet_list_end (& channel -> incomingReliableCommands);
-         currentCommand = enet_list_next (currentCommand))
+    for (;; incomingCommand = NULL)
     {
-       ENetIncomingCommand * incomingCommand = (ENetIncomingCommand *) currentCommand;
+       if (incomingCommand == NULL)
+       {
+          incomingCommand = enet_peer_find_incoming_reliable_command (channel, (enet_uint16) (channel -> incomingReliableSequenceNumber + 1));
+          if (incomingCommand == NULL || incomingCommand -> fragmentsRemaining > 0)
+            break;
 
-       if (incomingCommand -> fragmentsRemaining > 0 ||
-           incomingCommand -> reliableSequenceNumber != (enet_uint16) (channel -> incomingReliableSequenceNumber + 1))
-         break;
+          enet_peer_remove_incoming_reliable_command (channel, incomingCommand);
+       }
 
        channel -> incomingReliableSequenceNumber = incomingCommand -> reliableSequenceNumber;
 
-       if (incomingCommand -> fragmentCount > 0)
-         channel -> incomingReliableSequenceNumber += incomingCommand -> fragmentCount - 1;
+       if (incomingCommand -> fragmentCount > 1)
+       {
+          channel -> incomingReliableSequenceNumber += incomingCommand -> fragmentCount - 1;
+
+          enet_peer_discard_incoming_reliable_commands (peer, channel, incomingCommand -> reliableSequenceNumber + 1, incomingCommand -> fragmentCount - 1);
+       }
+
+       advanced = 1;
+
+       enet_list_insert (enet_list_end (& peer -> dispatchedCommands), incomingCommand);
+
+       dispatched = 1;
     }
 
-    if (currentCommand == enet_list_begin (& channel -> incomingReliableCommands))
+    if (! advanced)
       return;
 
     channel -> incomingUnreliableSequenceNumber = 0;
 
-    enet_list_move (enet_list_end (& peer -> dispatchedCommands), enet_list_begin (& channel -> incomingReliableCommands), enet_list_previous (currentCommand));
+    if (dispatched)
+      enet_peer_queue_dispatch (peer);
+
+    if (! enet_list_empty (& channel -> incomingUnreliableCommands))
+       enet_peer_dispatch_incoming_unreliable_commands (peer, channel);
+}
+
+static int
+enet_peer_receive_in_place (ENetPeer * peer, ENetChannel * channel, const ENetProtocol * command, const void * data, size_t dataLength, enet_uint32 flags, enet_uint32 unreliableSequenceNumber)
+{
+    int result;
+
+    if (command -> header.command & ENET_PROTOCOL_COMMAND_FLAG_AGGREGATE)
+      return 1;
 
-    if (! peer -> needsDispatch)
+    switch (command -> header.command & ENET_PROTOCOL_COMMAND_MASK)
     {
-       enet_list_insert (enet_list_end (& peer -> host -> dispatchQueue), & peer -> dispatchList);
+    case ENET_PROTOCOL_COMMAND_SEND_UNSEQUENCED:
+       break;
+
+    case ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE:
+       /* only hand out the data now if it would otherwise be dispatched immediately and
+          nothing queued ahead of it on the peer is still waiting to be delivered */
+       if (command -> header.reliableSequenceNumber != channel -> incomingReliableSequenceNumber ||
+           ! enet_list_empty (& channel -> incomingUnreliableCommands) ||
+           ! enet_list_empty (& peer -> dispatchedCommands))
+         return 1;
+       break;
 
-       peer -> needsDispatch = 1;
+    default:
+       return 1;
     }
 
-    if (! enet_list_empty (& channel -> incomingUnreliableCommands))
-       enet_peer_dispatch_incoming_unreliable_commands (peer, channel);
+    result = peer -> host -> receive (peer -> host, peer, command -> header.channelID, (const enet_uint8 *) data, dataLength, flags);
+    if (result != 0)
+      return result < 0 ? -1 : 1;
+
+    if ((command -> header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE)
+      channel -> incomingUnreliableSequenceNumber = unreliableSequenceNumber;
+
+    return 0;
 }
 
 ENetIncomingCommand *
@@ -829,7 +1750,7 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
     enet_uint32 unreliableSequenceNumber = 0, reliableSequenceNumber = 0;
     enet_uint16 reliableWindow, currentWindow;
     ENetIncomingCommand * incomingCommand;
-    ENetListIterator currentCommand;
+    ENetListIterator currentCommand = enet_list_end (& channel -> incomingUnreliableCommands);
     ENetPacket * packet = NULL;
 
     if (peer -> state == ENET_PEER_STATE_DISCONNECT_LATER)
@@ -852,32 +1773,20 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
     {
     case ENET_PROTOCOL_COMMAND_SEND_FRAGMENT:
     case ENET_PROTOCOL_COMMAND_SEND_RELIABLE:
-       if (reliableSequenceNumber == channel -> incomingReliableSequenceNumber)
-         goto discardCommand;
+       if (reliableSequenceNumber == channel -> incomingReliableSequenceNumber ||
+           enet_peer_find_incoming_reliable_command (channel, reliableSequenceNumber) != NULL)
+         goto duplicateCommand;
 
-       for (currentCommand = enet_list_previous (enet_list_end (& channel -> incomingReliableCommands));
-            currentCommand != enet_list_end (& channel -> incomingReliableCommands);
-            currentCommand = enet_list_previous (currentCommand))
+       if (reliableSequenceNumber != (enet_uint16) (channel -> incomingReliableSequenceNumber + 1))
        {
-          incomingCommand = (ENetIncomingCommand *) currentCommand;
-
-          if (reliableSequenceNumber >= channel -> incomingReliableSequenceNumber)
-          {
-             if (incomingCommand -> reliableSequenceNumber < channel -> incomingReliableSequenceNumber)
-               continue;
-          }
-          else
-          if (incomingCommand -> reliableSequenceNumber >= channel -> incomingReliableSequenceNumber)
-            break;
-
-          if (incomingCommand -> reliableSequenceNumber <= reliableSequenceNumber)
-          {
-             if (incomingCommand -> reliableSequenceNumber < reliableSequenceNumber)
-               break;
-
-             goto discardCommand;
-          }
+          ++ peer -> stats.outOfOrderCommands;
+          ++ peer -> host -> stats.outOfOrderCommands;
        }
+
+       /* a complete command that is next in sequence is dispatched right away and never waits in the table */
+       if ((reliableSequenceNumber != (enet_uint16) (channel -> incomingReliableSequenceNumber + 1) || fragmentCount > 0) &&
+           enet_sequence_table_reserve (& channel -> incomingReliableTable, reliableSequenceNumber) < 0)
+         goto notifyError;
        break;
 
     case ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE:
@@ -886,7 +1795,15 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
 
        if (reliableSequenceNumber == channel -> incomingReliableSequenceNumber &&
            unreliableSequenceNumber <= channel -> incomingUnreliableSequenceNumber)
-         goto discardCommand;
+       {
+          if (unreliableSequenceNumber == channel -> incomingUnreliableSequenceNumber)
+            goto duplicateCommand;
+
+          ++ peer -> stats.outOfOrderCommands;
+          ++ peer -> host -> stats.outOfOrderCommands;
+
+          goto discardCommand;
+       }
 
        for (currentCommand = enet_list_previous (enet_list_end (& channel -> incomingUnreliableCommands));
             currentCommand != enet_list_end (& channel -> incomingUnreliableCommands);
@@ -917,27 +1834,48 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
              if (incomingCommand -> unreliableSequenceNumber < unreliableSequenceNumber)
                break;
 
-             goto discardCommand;
+             goto duplicateCommand;
           }
        }
        break;
 
     case ENET_PROTOCOL_COMMAND_SEND_UNSEQUENCED:
-       currentCommand = enet_list_end (& channel -> incomingUnreliableCommands);
        break;
 
     default:
        goto discardCommand;
     }
 
+    if (peer -> host -> receive != NULL && fragmentCount == 0)
+    {
+       switch (enet_peer_receive_in_place (peer, channel, command, data, dataLength, flags, unreliableSequenceNumber))
+       {
+       case 0:
+          return & dummyCommand;
+
+       case -1:
+          peer -> host -> receiveFailed = 1;
+
+          goto notifyError;
+
+       default:
+          break;
+       }
+    }
+
     if (peer -> totalWaitingData >= peer -> host -> maximumWaitingData)
       goto notifyError;
 
-    packet = enet_packet_create (data, dataLength, flags);
+    /* the host's packet pool may only be released to from the thread servicing the host, so only
+       aggregates and compressed packets, which are replaced before reaching the application, use it */
+    if (command -> header.command & (ENET_PROTOCOL_COMMAND_FLAG_AGGREGATE | ENET_PROTOCOL_COMMAND_FLAG_COMPRESSED))
+      packet = enet_host_packet_create (peer -> host, data, dataLength, flags);
+    else
+      packet = enet_packet_create (data, dataLength, flags);
     if (packet == NULL)
       goto notifyError;
 
-    incomingCommand = (ENetIncomingCommand *) enet_malloc (sizeof (ENetIncomingCommand));
+    incomingCommand = (ENetIncomingCommand *) enet_object_pool_allocate (& peer -> host -> incomingCommandPool);
     if (incomingCommand == NULL)
       goto notifyError;
 
@@ -955,7 +1893,7 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
          incomingCommand -> fragments = (enet_uint32 *) enet_malloc ((fragmentCount + 31) / 32 * sizeof (enet_uint32));
        if (incomingCommand -> fragments == NULL)
        {
-          enet_free (incomingCommand);
+          enet_object_pool_free (& peer -> host -> incomingCommandPool, incomingCommand);
 
           goto notifyError;
        }
@@ -969,22 +1907,29 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
        peer -> totalWaitingData += packet -> dataLength;
     }
 
-    enet_list_insert (enet_list_next (currentCommand), incomingCommand);
-
     switch (command -> header.command & ENET_PROTOCOL_COMMAND_MASK)
     {
     case ENET_PROTOCOL_COMMAND_SEND_FRAGMENT:
     case ENET_PROTOCOL_COMMAND_SEND_RELIABLE:
-       enet_peer_dispatch_incoming_reliable_commands (peer, channel);
+       if (reliableSequenceNumber != (enet_uint16) (channel -> incomingReliableSequenceNumber + 1) || fragmentCount > 0)
+         enet_peer_insert_incoming_reliable_command (channel, incomingCommand);
+       else
+         enet_peer_dispatch_incoming_reliable_commands (peer, channel, incomingCommand);
        break;
 
     default:
+       enet_list_insert (enet_list_next (currentCommand), incomingCommand);
+
        enet_peer_dispatch_incoming_unreliable_commands (peer, channel);
        break;
     }
 
     return incomingCommand;
 
+duplicateCommand:
+    ++ peer -> stats.duplicateCommands;
+    ++ peer -> host -> stats.duplicateCommands;
+
 discardCommand:
     if (fragmentCount > 0)
       goto notifyError;
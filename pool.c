@@ -0,0 +1,122 @@
+/**
+ @file pool.c
+ @brief ENet fixed-size object pool functions
+*/
+#include <string.h>
+#define ENET_BUILDING_LIB 1
+#include "enet/enet.h"
+
+/**
+    @defgroup pool ENet fixed-size object pool utility functions
+    @ingroup private
+    @{
+*/
+
+/* each chunk begins with a link to the next chunk, padded so the objects that follow stay aligned */
+#define ENET_OBJECT_POOL_CHUNK_HEADER_SIZE ((sizeof (void *) + sizeof (double) - 1) & ~(sizeof (double) - 1))
+
+static int
+enet_object_pool_grow (ENetObjectPool * pool, size_t objectCount)
+{
+    enet_uint8 * chunk = (enet_uint8 *) enet_malloc (ENET_OBJECT_POOL_CHUNK_HEADER_SIZE + objectCount * pool -> objectSize);
+    enet_uint8 * object;
+
+    if (chunk == NULL)
+      return -1;
+
+    * (void **) chunk = pool -> chunks;
+    pool -> chunks = chunk;
+
+    for (object = chunk + ENET_OBJECT_POOL_CHUNK_HEADER_SIZE + (objectCount - 1) * pool -> objectSize;
+         object >= chunk + ENET_OBJECT_POOL_CHUNK_HEADER_SIZE;
+         object -= pool -> objectSize)
+    {
+       * (void **) object = pool -> freeObjects;
+       pool -> freeObjects = object;
+    }
+
+    pool -> objectCount += objectCount;
+
+    return 0;
+}
+
+/** Initializes a pool of fixed-size objects.
+    @param pool pool to initialize
+    @param objectSize size in bytes of each object handed out by the pool
+    @param initialCount number of objects to preallocate, which also sets the granularity the pool grows by
+    @retval 0 on success
+    @retval < 0 on failure
+*/
+int
+enet_object_pool_initialize (ENetObjectPool * pool, size_t objectSize, size_t initialCount)
+{
+    memset (pool, 0, sizeof (ENetObjectPool));
+
+    if (objectSize < sizeof (void *))
+      objectSize = sizeof (void *);
+    pool -> objectSize = (objectSize + sizeof (double) - 1) & ~(sizeof (double) - 1);
+
+    pool -> chunkSize = initialCount > ENET_OBJECT_POOL_MINIMUM_CHUNK_SIZE ? initialCount : ENET_OBJECT_POOL_MINIMUM_CHUNK_SIZE;
+
+    return enet_object_pool_grow (pool, pool -> chunkSize);
+}
+
+/** Releases all memory held by the pool. Every object must have been returned to the pool beforehand.
+    @param pool pool to destroy
+*/
+void
+enet_object_pool_destroy (ENetObjectPool * pool)
+{
+    while (pool -> chunks != NULL)
+    {
+       void * chunk = pool -> chunks;
+
+       pool -> chunks = * (void **) chunk;
+
+       enet_free (chunk);
+    }
+
+    pool -> freeObjects = NULL;
+    pool -> objectCount = 0;
+}
+
+/** Takes an object from the pool, growing the pool by another chunk if no free objects remain.
+    @param pool pool to allocate from
+    @returns the object on success, NULL on failure
+*/
+void *
+enet_object_pool_allocate (ENetObjectPool * pool)
+{
+    void * object;
+
+    if (pool -> freeObjects != NULL)
+      ++ pool -> hits;
+    else
+    {
+       ++ pool -> misses;
+
+       if (enet_object_pool_grow (pool, pool -> chunkSize) < 0)
+         return NULL;
+    }
+
+    object = pool -> freeObjects;
+    pool -> freeObjects = * (void **) object;
+
+    return object;
+}
+
+/** Returns an object to the pool it was allocated from.
+    @param pool pool the object belongs to
+    @param object object to return, may be NULL
+*/
+void
+enet_object_pool_free (ENetObjectPool * pool, void * object)
+{
+    if (object == NULL)
+      return;
+
+    * (void **) object = pool -> freeObjects;
+    pool -> freeObjects = object;
+}
+
+/** @} */
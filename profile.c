@@ -0,0 +1,162 @@
+/**
+ @file  profile.c
+ @brief ENet service profiling functions
+*/
+#include <string.h>
+#define ENET_BUILDING_LIB 1
+#include "enet/enet.h"
+#include "enet/internal/profile.h"
+
+#ifdef ENET_PROFILE
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#define ENET_PROFILE_READ_CYCLES() __rdtsc ()
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <x86intrin.h>
+#define ENET_PROFILE_READ_CYCLES() __rdtsc ()
+#elif !defined(_WIN32)
+#include <time.h>
+#endif
+#endif
+
+/** @defgroup profile ENet service profiling functions
+    @{
+*/
+
+#ifdef ENET_PROFILE
+
+/** Reads the processor's cycle counter, or a clock in nanoseconds where there is no known way to.
+*/
+enet_uint64
+enet_profile_cycles (void)
+{
+#if defined(ENET_PROFILE_READ_CYCLES)
+    return ENET_PROFILE_READ_CYCLES ();
+#elif defined(__GNUC__) && defined(__aarch64__)
+    enet_uint64 cycles;
+
+    __asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r" (cycles));
+
+    return cycles;
+#elif defined(_WIN32)
+    LARGE_INTEGER counter;
+
+    QueryPerformanceCounter (& counter);
+
+    return (enet_uint64) counter.QuadPart;
+#else
+    struct timespec now;
+
+    clock_gettime (CLOCK_MONOTONIC, & now);
+
+    return (enet_uint64) now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+static size_t
+enet_profile_bucket (enet_uint64 cycles)
+{
+    size_t bucket = 0;
+
+    if (cycles >> 32) { cycles >>= 32; bucket += 32; }
+    if (cycles >> 16) { cycles >>= 16; bucket += 16; }
+    if (cycles >> 8) { cycles >>= 8; bucket += 8; }
+    if (cycles >> 4) { cycles >>= 4; bucket += 4; }
+    if (cycles >> 2) { cycles >>= 2; bucket += 2; }
+    if (cycles >> 1) { cycles >>= 1; bucket += 1; }
+
+    bucket += (size_t) cycles;
+
+    return bucket < ENET_PROFILE_HISTOGRAM_BUCKETS ? bucket : ENET_PROFILE_HISTOGRAM_BUCKETS - 1;
+}
+
+/** Records the time taken by a phase of servicing a host started at the given time.
+    @param host host being profiled
+    @param phase phase that was timed
+    @param peer peer the time was spent on behalf of, or NULL if none
+    @param start value of enet_profile_cycles() when the phase began
+*/
+void
+enet_profile_stop (ENetHost * host, ENetProfilePhase phase, ENetPeer * peer, enet_uint64 start)
+{
+    enet_uint64 cycles = enet_profile_cycles () - start;
+
+    if (host -> profileHistograms != NULL)
+    {
+       ENetProfileHistogram * histogram = & host -> profileHistograms [phase];
+
+       ++ histogram -> samples;
+       histogram -> cycles += cycles;
+       if (cycles > histogram -> maximum)
+         histogram -> maximum = cycles;
+       ++ histogram -> buckets [enet_profile_bucket (cycles)];
+    }
+
+    if (peer != NULL && host -> profileFlags & ENET_HOST_PROFILE_PEERS)
+    {
+       peer -> stats.cycles += cycles;
+       host -> stats.cycles += cycles;
+    }
+}
+
+#endif
+
+/** Enables or disables profiling of the time a host spends servicing its peers.
+    @param host host to profile
+    @param flags ENET_HOST_PROFILE_* flags of what to record, 0 to stop profiling
+    @retval 0 on success
+    @retval < 0 if the library was built without ENET_PROFILE, or on failure
+    @remarks enabling phase histograms again clears the ones recorded so far
+*/
+int
+enet_host_profile (ENetHost * host, enet_uint32 flags)
+{
+#ifdef ENET_PROFILE
+    if (flags & ENET_HOST_PROFILE_PHASES)
+    {
+       if (host -> profileHistograms == NULL)
+       {
+          host -> profileHistograms = (ENetProfileHistogram *) enet_malloc (ENET_PROFILE_PHASE_COUNT * sizeof (ENetProfileHistogram));
+          if (host -> profileHistograms == NULL)
+            return -1;
+       }
+
+       memset (host -> profileHistograms, 0, ENET_PROFILE_PHASE_COUNT * sizeof (ENetProfileHistogram));
+    }
+    else
+    if (host -> profileHistograms != NULL)
+    {
+       enet_free (host -> profileHistograms);
+
+       host -> profileHistograms = NULL;
+    }
+
+    host -> profileFlags = flags;
+
+    return 0;
+#else
+    (void) host;
+
+    return flags ? -1 : 0;
+#endif
+}
+
+/** Retrieves the histogram of the time taken by a phase of servicing a host.
+    @param host host being profiled
+    @param phase phase to retrieve the histogram of
+    @param histogram receives the histogram
+    @retval 0 on success
+    @retval < 0 if phases are not being profiled
+*/
+int
+enet_host_get_profile (const ENetHost * host, ENetProfilePhase phase, ENetProfileHistogram * histogram)
+{
+    if (host -> profileHistograms == NULL || (unsigned) phase >= ENET_PROFILE_PHASE_COUNT)
+      return -1;
+
+    * histogram = host -> profileHistograms [phase];
+
+    return 0;
+}
+
+/** @} */
@@ -8,6 +8,8 @@
 #include "enet/utility.h"
 #include "enet/time.h"
 #include "enet/enet.h"
+#include "enet/internal/profile.h"
+#include "enet/internal/trace.h"
 
 static size_t commandSizes [ENET_PROTOCOL_COMMAND_COUNT] =
 {
@@ -32,6 +34,408 @@ enet_protocol_command_size (enet_uint8 commandNumber)
     return commandSizes [commandNumber & ENET_PROTOCOL_COMMAND_MASK];
 }
 
+/** Writes a variable length integer, 7 bits per byte starting with the least significant
+    ones, with the high bit set on all but the last byte.
+    @param data buffer with room for at least 5 bytes
+    @param value value to write
+    @returns the number of bytes written
+*/
+size_t
+enet_protocol_write_varint (enet_uint8 * data, enet_uint32 value)
+{
+    size_t length = 0;
+
+    while (value >= 0x80)
+    {
+       data [length ++] = (enet_uint8) (value | 0x80);
+       value >>= 7;
+    }
+
+    data [length ++] = (enet_uint8) value;
+
+    return length;
+}
+
+/** Reads a variable length integer written by enet_protocol_write_varint().
+    @param data position to read from, advanced past the integer
+    @param dataEnd end of the data that may be read
+    @param value holds the value read on success
+    @retval 0 on success
+    @retval < 0 if the integer is truncated or does not fit in 32 bits
+*/
+int
+enet_protocol_read_varint (const enet_uint8 ** data, const enet_uint8 * dataEnd, enet_uint32 * value)
+{
+    enet_uint32 result = 0;
+    int shift;
+
+    for (shift = 0; shift < 35; shift += 7)
+    {
+       enet_uint8 byte;
+
+       if (* data >= dataEnd)
+         return -1;
+
+       byte = * (* data) ++;
+       if (shift == 28 && byte > 0x0F)
+         return -1;
+
+       result |= (enet_uint32) (byte & 0x7F) << shift;
+
+       if (! (byte & 0x80))
+       {
+          * value = result;
+
+          return 0;
+       }
+    }
+
+    return -1;
+}
+
+/* The compact encoding of a command is its command byte, a variable length integer holding the
+   zigzag coded difference between its reliable sequence number and that of the previous command
+   in the datagram shifted left by one, with the low bit set if the channel ID follows because it
+   differs from that of the previous command, and then the fields of the command. Lengths, counts,
+   offsets and sequence numbers are variable length integers, the start sequence number of a
+   fragment and the sequence number an acknowledgement refers to being coded as zigzag differences
+   from the reliable sequence number of the command itself. Other fields, and all fields of
+   commands that are rarely sent, keep their classic encoding. The first command of a datagram is
+   compared against a reliable sequence number of 0 on channel 0xFF. */
+
+static enet_uint32
+enet_protocol_zigzag_difference (enet_uint16 value, enet_uint16 base)
+{
+    enet_uint16 difference = (enet_uint16) (value - base);
+
+    return difference & 0x8000 ? ((enet_uint32) (0xFFFF - difference) << 1) | 1 : (enet_uint32) difference << 1;
+}
+
+static enet_uint16
+enet_protocol_zigzag_value (enet_uint32 zigzag, enet_uint16 base)
+{
+    return (enet_uint16) (base + (zigzag & 1 ? 0xFFFF - (zigzag >> 1) : zigzag >> 1));
+}
+
+/** Encodes a command of the datagram being sent in the compact encoding.
+    @param command command in the classic encoding
+    @param previous header of the previous command in the datagram, in host byte order, updated to this command
+    @param data buffer with room for the classic encoding of the command
+    @returns the length of the compact encoding, or 0 if it would not be shorter than the classic one
+*/
+static size_t
+enet_protocol_encode_compact_command (const ENetProtocol * command, ENetProtocolCommandHeader * previous, enet_uint8 * data)
+{
+    enet_uint8 buffer [sizeof (ENetProtocol) + 16], * current = buffer;
+    enet_uint8 commandNumber = command -> header.command & ENET_PROTOCOL_COMMAND_MASK;
+    enet_uint16 reliableSequenceNumber = ENET_NET_TO_HOST_16 (command -> header.reliableSequenceNumber);
+    size_t commandSize = commandSizes [commandNumber];
+    int channelFollows = command -> header.channelID != previous -> channelID;
+
+    * current ++ = command -> header.command;
+    current += enet_protocol_write_varint (current, (enet_protocol_zigzag_difference (reliableSequenceNumber, previous -> reliableSequenceNumber) << 1) | channelFollows);
+    if (channelFollows)
+      * current ++ = command -> header.channelID;
+
+    switch (commandNumber)
+    {
+    case ENET_PROTOCOL_COMMAND_ACKNOWLEDGE:
+       current += enet_protocol_write_varint (current, enet_protocol_zigzag_difference (ENET_NET_TO_HOST_16 (command -> acknowledge.receivedReliableSequenceNumber), reliableSequenceNumber));
+       memcpy (current, & command -> acknowledge.receivedSentTime, sizeof (enet_uint16));
+       current += sizeof (enet_uint16);
+       break;
+
+    case ENET_PROTOCOL_COMMAND_SEND_RELIABLE:
+       current += enet_protocol_write_varint (current, ENET_NET_TO_HOST_16 (command -> sendReliable.dataLength));
+       break;
+
+    case ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE:
+       current += enet_protocol_write_varint (current, ENET_NET_TO_HOST_16 (command -> sendUnreliable.unreliableSequenceNumber));
+       current += enet_protocol_write_varint (current, ENET_NET_TO_HOST_16 (command -> sendUnreliable.dataLength));
+       break;
+
+    case ENET_PROTOCOL_COMMAND_SEND_UNSEQUENCED:
+       memcpy (current, & command -> sendUnsequenced.unsequencedGroup, sizeof (enet_uint16));
+       current += sizeof (enet_uint16);
+       current += enet_protocol_write_varint (current, ENET_NET_TO_HOST_16 (command -> sendUnsequenced.dataLength));
+       break;
+
+    case ENET_PROTOCOL_COMMAND_SEND_FRAGMENT:
+    case ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE_FRAGMENT:
+       current += enet_protocol_write_varint (current, enet_protocol_zigzag_difference (ENET_NET_TO_HOST_16 (command -> sendFragment.startSequenceNumber), reliableSequenceNumber));
+       current += enet_protocol_write_varint (current, ENET_NET_TO_HOST_16 (command -> sendFragment.dataLength));
+       current += enet_protocol_write_varint (current, ENET_NET_TO_HOST_32 (command -> sendFragment.fragmentCount));
+       current += enet_protocol_write_varint (current, ENET_NET_TO_HOST_32 (command -> sendFragment.fragmentNumber));
+       current += enet_protocol_write_varint (current, ENET_NET_TO_HOST_32 (command -> sendFragment.totalLength));
+       current += enet_protocol_write_varint (current, ENET_NET_TO_HOST_32 (command -> sendFragment.fragmentOffset));
+       break;
+
+    default:
+       memcpy (current, (const enet_uint8 *) command + sizeof (ENetProtocolCommandHeader), commandSize - sizeof (ENetProtocolCommandHeader));
+       current += commandSize - sizeof (ENetProtocolCommandHeader);
+       break;
+    }
+
+    if ((size_t) (current - buffer) >= commandSize)
+      return 0;
+
+    memcpy (data, buffer, current - buffer);
+
+    previous -> channelID = command -> header.channelID;
+    previous -> reliableSequenceNumber = reliableSequenceNumber;
+
+    return current - buffer;
+}
+
+/** Switches the datagram being sent to the peer to the compact encoding if that makes it shorter,
+    rewriting its commands in place. The commands are encoded once to measure the datagram and
+    then again into their own slots.
+*/
+static void
+enet_protocol_compact_commands (ENetHost * host)
+{
+    enet_uint8 compactData [sizeof (ENetProtocol)];
+    ENetProtocolCommandHeader previous;
+    ENetBuffer * buffer;
+    size_t commandIndex, commandLength, classicLength = 0, compactLength = 1;
+
+    previous.channelID = 0xFF;
+    previous.reliableSequenceNumber = 0;
+
+    for (commandIndex = 0; commandIndex < host -> commandCount; ++ commandIndex)
+    {
+       const ENetProtocol * command = & host -> commands [commandIndex];
+
+       commandLength = enet_protocol_encode_compact_command (command, & previous, compactData);
+       if (commandLength == 0)
+         return;
+
+       classicLength += commandSizes [command -> header.command & ENET_PROTOCOL_COMMAND_MASK];
+       compactLength += commandLength;
+    }
+
+    if (compactLength >= classicLength)
+      return;
+
+    previous.channelID = 0xFF;
+    previous.reliableSequenceNumber = 0;
+
+    for (commandIndex = 0, buffer = & host -> buffers [1];
+         buffer < & host -> buffers [host -> bufferCount];
+         ++ buffer)
+    {
+       enet_uint8 * data = (enet_uint8 *) buffer -> data;
+
+       if (buffer -> data != & host -> commands [commandIndex])
+         continue;
+
+       commandLength = enet_protocol_encode_compact_command (& host -> commands [commandIndex], & previous, compactData);
+
+       if (commandIndex == 0)
+         * data ++ = ENET_PROTOCOL_COMMAND_COMPACT;
+
+       memcpy (data, compactData, commandLength);
+
+       buffer -> dataLength = (data - (enet_uint8 *) buffer -> data) + commandLength;
+
+       if (++ commandIndex >= host -> commandCount)
+         break;
+    }
+
+    host -> packetSize -= classicLength - compactLength;
+}
+
+/** Decodes a command in the compact encoding into its classic encoding.
+    @param host host that received the datagram
+    @param currentData position of the command, advanced past it
+    @param previous header of the previous command in the datagram, in host byte order, updated to this command
+    @param command holds the command in the classic encoding on success
+    @retval 0 on success
+    @retval < 0 if the command is malformed
+*/
+static int
+enet_protocol_decode_compact_command (ENetHost * host, enet_uint8 ** currentData, ENetProtocolCommandHeader * previous, ENetProtocol * command)
+{
+    const enet_uint8 * current = * currentData,
+                     * dataEnd = & host -> receivedData [host -> receivedDataLength];
+    enet_uint32 header, value [6];
+    enet_uint8 commandNumber;
+    enet_uint16 reliableSequenceNumber;
+    size_t commandSize;
+
+    if (current >= dataEnd)
+      return -1;
+
+    command -> header.command = * current ++;
+    commandNumber = command -> header.command & ENET_PROTOCOL_COMMAND_MASK;
+    if (commandNumber >= ENET_PROTOCOL_COMMAND_COUNT)
+      return -1;
+
+    commandSize = commandSizes [commandNumber];
+    if (commandSize == 0 ||
+        enet_protocol_read_varint (& current, dataEnd, & header) < 0 ||
+        (header >> 1) > 0xFFFF)
+      return -1;
+
+    reliableSequenceNumber = enet_protocol_zigzag_value (header >> 1, previous -> reliableSequenceNumber);
+    command -> header.reliableSequenceNumber = ENET_HOST_TO_NET_16 (reliableSequenceNumber);
+
+    if (header & 1)
+    {
+       if (current >= dataEnd)
+         return -1;
+
+       command -> header.channelID = * current ++;
+    }
+    else
+      command -> header.channelID = previous -> channelID;
+
+    switch (commandNumber)
+    {
+    case ENET_PROTOCOL_COMMAND_ACKNOWLEDGE:
+       if (enet_protocol_read_varint (& current, dataEnd, & value [0]) < 0 || value [0] > 0xFFFF ||
+           current + sizeof (enet_uint16) > dataEnd)
+         return -1;
+       command -> acknowledge.receivedReliableSequenceNumber = ENET_HOST_TO_NET_16 (enet_protocol_zigzag_value (value [0], reliableSequenceNumber));
+       memcpy (& command -> acknowledge.receivedSentTime, current, sizeof (enet_uint16));
+       current += sizeof (enet_uint16);
+       break;
+
+    case ENET_PROTOCOL_COMMAND_SEND_RELIABLE:
+       if (enet_protocol_read_varint (& current, dataEnd, & value [0]) < 0 || value [0] > 0xFFFF)
+         return -1;
+       command -> sendReliable.dataLength = ENET_HOST_TO_NET_16 (value [0]);
+       break;
+
+    case ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE:
+       if (enet_protocol_read_varint (& current, dataEnd, & value [0]) < 0 || value [0] > 0xFFFF ||
+           enet_protocol_read_varint (& current, dataEnd, & value [1]) < 0 || value [1] > 0xFFFF)
+         return -1;
+       command -> sendUnreliable.unreliableSequenceNumber = ENET_HOST_TO_NET_16 (value [0]);
+       command -> sendUnreliable.dataLength = ENET_HOST_TO_NET_16 (value [1]);
+       break;
+
+    case ENET_PROTOCOL_COMMAND_SEND_UNSEQUENCED:
+       if (current + sizeof (enet_uint16) > dataEnd)
+         return -1;
+       memcpy (& command -> sendUnsequenced.unsequencedGroup, current, sizeof (enet_uint16));
+       current += sizeof (enet_uint16);
+       if (enet_protocol_read_varint (& current, dataEnd, & value [0]) < 0 || value [0] > 0xFFFF)
+         return -1;
+       command -> sendUnsequenced.dataLength = ENET_HOST_TO_NET_16 (value [0]);
+       break;
+
+    case ENET_PROTOCOL_COMMAND_SEND_FRAGMENT:
+    case ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE_FRAGMENT:
+    {
+       int field;
+
+       for (field = 0; field < 6; ++ field)
+       {
+          if (enet_protocol_read_varint (& current, dataEnd, & value [field]) < 0)
+            return -1;
+       }
+
+       if (value [0] > 0xFFFF || value [1] > 0xFFFF)
+         return -1;
+
+       command -> sendFragment.startSequenceNumber = ENET_HOST_TO_NET_16 (enet_protocol_zigzag_value (value [0], reliableSequenceNumber));
+       command -> sendFragment.dataLength = ENET_HOST_TO_NET_16 (value [1]);
+       command -> sendFragment.fragmentCount = ENET_HOST_TO_NET_32 (value [2]);
+       command -> sendFragment.fragmentNumber = ENET_HOST_TO_NET_32 (value [3]);
+       command -> sendFragment.totalLength = ENET_HOST_TO_NET_32 (value [4]);
+       command -> sendFragment.fragmentOffset = ENET_HOST_TO_NET_32 (value [5]);
+       break;
+    }
+
+    default:
+       if (current + commandSize - sizeof (ENetProtocolCommandHeader) > dataEnd)
+         return -1;
+       memcpy ((enet_uint8 *) command + sizeof (ENetProtocolCommandHeader), current, commandSize - sizeof (ENetProtocolCommandHeader));
+       current += commandSize - sizeof (ENetProtocolCommandHeader);
+       break;
+    }
+
+    previous -> channelID = command -> header.channelID;
+    previous -> reliableSequenceNumber = reliableSequenceNumber;
+
+    * currentData = (enet_uint8 *) current;
+
+    return 0;
+}
+
+/** Creates the extension that trails a connect or verify connect command to advertise protocol features.
+    @param host host the extension will be sent from
+    @param features ENET_PROTOCOL_FEATURE_* flags to advertise
+    @returns the extension packet, or NULL if there are no features to advertise or on failure
+*/
+ENetPacket *
+enet_protocol_create_extension (ENetHost * host, enet_uint32 features)
+{
+    ENetProtocolExtension extension;
+
+    if (features == 0)
+      return NULL;
+
+    extension.header.command = ENET_PROTOCOL_COMMAND_NONE;
+    extension.header.channelID = 0xFF;
+    extension.header.reliableSequenceNumber = ENET_HOST_TO_NET_16 (ENET_PROTOCOL_EXTENSION_MAGIC);
+    extension.dataLength = ENET_HOST_TO_NET_16 (sizeof (ENetProtocolExtension));
+    extension.features = ENET_HOST_TO_NET_32 (features);
+    extension.dictionaryHash = ENET_HOST_TO_NET_32 (features & ENET_PROTOCOL_FEATURE_DICTIONARY ? host -> dictionaryHash : 0);
+
+    return enet_host_packet_create (host, & extension, sizeof (ENetProtocolExtension), 0);
+}
+
+static int
+enet_protocol_read_extension (ENetHost * host, enet_uint8 ** currentData, ENetProtocolExtension * extension)
+{
+    const ENetProtocolExtension * data = (const ENetProtocolExtension *) * currentData;
+    size_t dataLength;
+
+    memset (extension, 0, sizeof (ENetProtocolExtension));
+
+    if (* currentData + (size_t) & ((ENetProtocolExtension *) 0) -> features > & host -> receivedData [host -> receivedDataLength] ||
+        data -> header.command != ENET_PROTOCOL_COMMAND_NONE ||
+        data -> header.channelID != 0xFF ||
+        ENET_NET_TO_HOST_16 (data -> header.reliableSequenceNumber) != ENET_PROTOCOL_EXTENSION_MAGIC)
+      return 0;
+
+    /* extensions from newer peers may be longer and older ones shorter, so only the
+       fields both ends know about are read and the rest remain zeroed */
+    dataLength = ENET_NET_TO_HOST_16 (data -> dataLength);
+    if (dataLength < (size_t) & ((ENetProtocolExtension *) 0) -> features ||
+        * currentData + dataLength > & host -> receivedData [host -> receivedDataLength])
+      return 0;
+
+    memcpy (extension, data, ENET_MIN (dataLength, sizeof (ENetProtocolExtension)));
+    extension -> features = ENET_NET_TO_HOST_32 (extension -> features);
+    extension -> dictionaryHash = ENET_NET_TO_HOST_32 (extension -> dictionaryHash);
+
+    * currentData += dataLength;
+
+    return 1;
+}
+
+static void
+enet_protocol_negotiate_features (ENetHost * host, ENetPeer * peer, const ENetProtocolExtension * extension)
+{
+    peer -> protocolFeatures = extension -> features & host -> protocolFeatures;
+
+    if (extension -> dictionaryHash != host -> dictionaryHash)
+      peer -> protocolFeatures &= ~ ENET_PROTOCOL_FEATURE_DICTIONARY;
+}
+
+/** Returns the compressor datagrams exchanged with the peer are compressed with. */
+static ENetCompressor *
+enet_protocol_peer_compressor (ENetHost * host, ENetPeer * peer)
+{
+    if (peer != NULL && peer -> protocolFeatures & ENET_PROTOCOL_FEATURE_DICTIONARY)
+      return & host -> dictionaryCompressor;
+
+    return & host -> compressor;
+}
+
 static void
 enet_protocol_change_state (ENetHost * host, ENetPeer * peer, ENetPeerState state)
 {
@@ -40,6 +444,8 @@ enet_protocol_change_state (ENetHost * host, ENetPeer * peer, ENetPeerState stat
     else
       enet_peer_on_disconnect (peer);
 
+    ENET_PROBE3 (peer__state, peer, peer -> state, state);
+
     peer -> state = state;
 }
 
@@ -48,20 +454,63 @@ enet_protocol_dispatch_state (ENetHost * host, ENetPeer * peer, ENetPeerState st
 {
     enet_protocol_change_state (host, peer, state);
 
-    if (! peer -> needsDispatch)
+    enet_peer_queue_dispatch (peer);
+}
+
+static void
+enet_protocol_notify_disconnect (ENetHost * host, ENetPeer * peer, ENetEvent * event)
+{
+    if (peer -> state >= ENET_PEER_STATE_CONNECTION_PENDING)
+       host -> recalculateBandwidthLimits = 1;
+
+    if (peer -> state != ENET_PEER_STATE_CONNECTING && peer -> state < ENET_PEER_STATE_CONNECTION_SUCCEEDED)
+        enet_peer_reset (peer);
+    else
+    if (event != NULL)
+    {
+        event -> type = ENET_EVENT_TYPE_DISCONNECT;
+        event -> peer = peer;
+        event -> data = 0;
+
+        enet_peer_reset (peer);
+    }
+    else
     {
-       enet_list_insert (enet_list_end (& host -> dispatchQueue), & peer -> dispatchList);
+        peer -> eventData = 0;
 
-       peer -> needsDispatch = 1;
+        enet_protocol_dispatch_state (host, peer, ENET_PEER_STATE_ZOMBIE);
     }
 }
 
+static ENetPeer *
+enet_protocol_next_dispatch_peer (ENetHost * host, ENetList * * dispatchQueue)
+{
+    ENetList * currentQueue;
+
+    for (currentQueue = host -> dispatchQueues;
+         currentQueue < & host -> dispatchQueues [ENET_PEER_DISPATCH_PRIORITIES];
+         ++ currentQueue)
+    {
+       if (! enet_list_empty (currentQueue))
+       {
+          * dispatchQueue = currentQueue;
+
+          return (ENetPeer *) enet_list_remove (enet_list_begin (currentQueue));
+       }
+    }
+
+    return NULL;
+}
+
 static int
-enet_protocol_dispatch_incoming_commands (ENetHost * host, ENetEvent * event)
+enet_protocol_dispatch_next_event (ENetHost * host, ENetEvent * event)
 {
-    while (! enet_list_empty (& host -> dispatchQueue))
+    ENetList * dispatchQueue;
+    ENetPeer * peer;
+
+    while ((peer = enet_protocol_next_dispatch_peer (host, & dispatchQueue)) != NULL)
     {
-       ENetPeer * peer = (ENetPeer *) enet_list_remove (enet_list_begin (& host -> dispatchQueue));
+       size_t packetLength;
 
        peer -> needsDispatch = 0;
 
@@ -92,19 +541,51 @@ enet_protocol_dispatch_incoming_commands (ENetHost * host, ENetEvent * event)
            if (enet_list_empty (& peer -> dispatchedCommands))
              continue;
 
+           /* deficit round robin: a peer whose next packet does not fit in what is left of its turn
+              goes to the back of its class with another quantum, unless no one else is waiting */
+           packetLength = ((ENetIncomingCommand *) enet_list_front (& peer -> dispatchedCommands)) -> packet -> dataLength;
+           if (packetLength > peer -> dispatchDeficit && ! enet_list_empty (dispatchQueue))
+           {
+              if (peer -> dispatchDeficit < ~0u - peer -> dispatchQuantum)
+                peer -> dispatchDeficit += peer -> dispatchQuantum;
+
+              peer -> needsDispatch = 1;
+
+              enet_list_insert (enet_list_end (dispatchQueue), & peer -> dispatchList);
+
+              continue;
+           }
+
            event -> packet = enet_peer_receive (peer, & event -> channelID);
            if (event -> packet == NULL)
-             continue;
+           {
+              /* an aggregate of coalesced packets that was already acknowledged could not be
+                 unpacked, so rather than deliver the rest of the stream with a gap the peer is failed */
+              if (! enet_list_empty (& peer -> dispatchedCommands))
+              {
+                 enet_protocol_notify_disconnect (host, peer, event);
+
+                 return 1;
+              }
+
+              continue;
+           }
 
            event -> type = ENET_EVENT_TYPE_RECEIVE;
            event -> peer = peer;
 
+           packetLength = event -> packet -> dataLength;
+           peer -> dispatchDeficit = packetLength < peer -> dispatchDeficit ? peer -> dispatchDeficit - packetLength : 0;
+
            if (! enet_list_empty (& peer -> dispatchedCommands))
            {
+              /* the peer keeps its turn for as long as its deficit lasts */
               peer -> needsDispatch = 1;
 
-              enet_list_insert (enet_list_end (& host -> dispatchQueue), & peer -> dispatchList);
+              enet_list_insert (enet_list_begin (dispatchQueue), & peer -> dispatchList);
            }
+           else
+             peer -> dispatchDeficit = 0;
 
            return 1;
 
@@ -116,6 +597,19 @@ enet_protocol_dispatch_incoming_commands (ENetHost * host, ENetEvent * event)
     return 0;
 }
 
+static int
+enet_protocol_dispatch_incoming_commands (ENetHost * host, ENetEvent * event)
+{
+    enet_uint64 profileStart;
+    int result;
+
+    ENET_PROFILE_START (host, profileStart);
+    result = enet_protocol_dispatch_next_event (host, event);
+    ENET_PROFILE_STOP (host, ENET_PROFILE_PHASE_DISPATCH, result > 0 ? event -> peer : NULL, profileStart);
+
+    return result;
+}
+
 static void
 enet_protocol_notify_connect (ENetHost * host, ENetPeer * peer, ENetEvent * event)
 {
@@ -133,31 +627,6 @@ enet_protocol_notify_connect (ENetHost * host, ENetPeer * peer, ENetEvent * even
         enet_protocol_dispatch_state (host, peer, peer -> state == ENET_PEER_STATE_CONNECTING ? ENET_PEER_STATE_CONNECTION_SUCCEEDED : ENET_PEER_STATE_CONNECTION_PENDING);
 }
 
-static void
-enet_protocol_notify_disconnect (ENetHost * host, ENetPeer * peer, ENetEvent * event)
-{
-    if (peer -> state >= ENET_PEER_STATE_CONNECTION_PENDING)
-       host -> recalculateBandwidthLimits = 1;
-
-    if (peer -> state != ENET_PEER_STATE_CONNECTING && peer -> state < ENET_PEER_STATE_CONNECTION_SUCCEEDED)
-        enet_peer_reset (peer);
-    else
-    if (event != NULL)
-    {
-        event -> type = ENET_EVENT_TYPE_DISCONNECT;
-        event -> peer = peer;
-        event -> data = 0;
-
-        enet_peer_reset (peer);
-    }
-    else
-    {
-        peer -> eventData = 0;
-
-        enet_protocol_dispatch_state (host, peer, ENET_PEER_STATE_ZOMBIE);
-    }
-}
-
 static void
 enet_protocol_remove_sent_unreliable_commands (ENetPeer * peer)
 {
@@ -181,53 +650,30 @@ enet_protocol_remove_sent_unreliable_commands (ENetPeer * peer)
            }
         }
 
-        enet_free (outgoingCommand);
+        enet_object_pool_free (& peer -> host -> outgoingCommandPool, outgoingCommand);
     }
 }
 
+static ENetSequenceTable **
+enet_protocol_sent_reliable_table (ENetPeer * peer, enet_uint8 channelID)
+{
+    return channelID < peer -> channelCount ? & peer -> channels [channelID].sentReliableTable : & peer -> sentReliableTable;
+}
+
 static ENetProtocolCommand
 enet_protocol_remove_sent_reliable_command (ENetPeer * peer, enet_uint16 reliableSequenceNumber, enet_uint8 channelID)
 {
-    ENetOutgoingCommand * outgoingCommand = NULL;
-    ENetListIterator currentCommand;
+    ENetSequenceTable ** sentReliableTable = enet_protocol_sent_reliable_table (peer, channelID);
+    ENetOutgoingCommand * outgoingCommand;
     ENetProtocolCommand commandNumber;
-    int wasSent = 1;
-
-    for (currentCommand = enet_list_begin (& peer -> sentReliableCommands);
-         currentCommand != enet_list_end (& peer -> sentReliableCommands);
-         currentCommand = enet_list_next (currentCommand))
-    {
-       outgoingCommand = (ENetOutgoingCommand *) currentCommand;
-
-       if (outgoingCommand -> reliableSequenceNumber == reliableSequenceNumber &&
-           outgoingCommand -> command.header.channelID == channelID)
-         break;
-    }
-
-    if (currentCommand == enet_list_end (& peer -> sentReliableCommands))
-    {
-       for (currentCommand = enet_list_begin (& peer -> outgoingReliableCommands);
-            currentCommand != enet_list_end (& peer -> outgoingReliableCommands);
-            currentCommand = enet_list_next (currentCommand))
-       {
-          outgoingCommand = (ENetOutgoingCommand *) currentCommand;
-
-          if (outgoingCommand -> sendAttempts < 1) return ENET_PROTOCOL_COMMAND_NONE;
-
-          if (outgoingCommand -> reliableSequenceNumber == reliableSequenceNumber &&
-              outgoingCommand -> command.header.channelID == channelID)
-            break;
-       }
-
-       if (currentCommand == enet_list_end (& peer -> outgoingReliableCommands))
-         return ENET_PROTOCOL_COMMAND_NONE;
 
-       wasSent = 0;
-    }
-
-    if (outgoingCommand == NULL)
+    outgoingCommand = (ENetOutgoingCommand *) enet_sequence_table_find (* sentReliableTable, reliableSequenceNumber);
+    if (outgoingCommand == NULL ||
+        outgoingCommand -> command.header.channelID != channelID)
       return ENET_PROTOCOL_COMMAND_NONE;
 
+    enet_sequence_table_remove (* sentReliableTable, reliableSequenceNumber);
+
     if (channelID < peer -> channelCount)
     {
        ENetChannel * channel = & peer -> channels [channelID];
@@ -246,7 +692,7 @@ enet_protocol_remove_sent_reliable_command (ENetPeer * peer, enet_uint16 reliabl
 
     if (outgoingCommand -> packet != NULL)
     {
-       if (wasSent)
+       if (outgoingCommand -> inTransit)
          peer -> reliableDataInTransit -= outgoingCommand -> fragmentLength;
 
        -- outgoingCommand -> packet -> referenceCount;
@@ -259,7 +705,7 @@ enet_protocol_remove_sent_reliable_command (ENetPeer * peer, enet_uint16 reliabl
        }
     }
 
-    enet_free (outgoingCommand);
+    enet_object_pool_free (& peer -> host -> outgoingCommandPool, outgoingCommand);
 
     if (enet_list_empty (& peer -> sentReliableCommands))
       return commandNumber;
@@ -272,7 +718,7 @@ enet_protocol_remove_sent_reliable_command (ENetPeer * peer, enet_uint16 reliabl
 }
 
 static ENetPeer *
-enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENetProtocol * command)
+enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENetProtocol * command, const ENetProtocolExtension * extension)
 {
     enet_uint8 incomingSessionID, outgoingSessionID;
     enet_uint32 mtu, windowSize;
@@ -280,6 +726,7 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
     size_t channelCount, duplicatePeers = 0;
     ENetPeer * currentPeer, * peer = NULL;
     ENetProtocol verifyCommand;
+    ENetPacket * verifyExtension = NULL;
 
     channelCount = ENET_NET_TO_HOST_32 (command -> connect.channelCount);
 
@@ -320,6 +767,7 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
     peer -> state = ENET_PEER_STATE_ACKNOWLEDGING_CONNECT;
     peer -> connectID = command -> connect.connectID;
     peer -> address = host -> receivedAddress;
+    memset (& peer -> stats, 0, sizeof (peer -> stats));
     peer -> outgoingPeerID = ENET_NET_TO_HOST_16 (command -> connect.outgoingPeerID);
     peer -> incomingBandwidth = ENET_NET_TO_HOST_32 (command -> connect.incomingBandwidth);
     peer -> outgoingBandwidth = ENET_NET_TO_HOST_32 (command -> connect.outgoingBandwidth);
@@ -351,9 +799,24 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
 
         enet_list_clear (& channel -> incomingReliableCommands);
         enet_list_clear (& channel -> incomingUnreliableCommands);
+        enet_list_clear (& channel -> outgoingReliableCommands);
+        enet_list_clear (& channel -> outgoingUnreliableCommands);
+
+        channel -> needsSend = 0;
+        channel -> sendPriority = ENET_PEER_CHANNEL_PRIORITY;
+        channel -> sendWeight = ENET_PEER_CHANNEL_WEIGHT;
+        channel -> sendDeficit = 0;
 
         channel -> usedReliableWindows = 0;
         memset (channel -> reliableWindows, 0, sizeof (channel -> reliableWindows));
+
+        channel -> outgoingStream = NULL;
+        channel -> incomingStream = NULL;
+        channel -> incomingReliableTable = NULL;
+        channel -> sentReliableTable = NULL;
+        channel -> outgoingSlotTable = NULL;
+        channel -> coalescedPacket = NULL;
+        channel -> coalescedTime = 0;
     }
 
     mtu = ENET_NET_TO_HOST_32 (command -> connect.mtu);
@@ -416,7 +879,16 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
     verifyCommand.verifyConnect.packetThrottleDeceleration = ENET_HOST_TO_NET_32 (peer -> packetThrottleDeceleration);
     verifyCommand.verifyConnect.connectID = peer -> connectID;
 
-    enet_peer_queue_outgoing_command (peer, & verifyCommand, NULL, 0, 0);
+    if (extension != NULL)
+    {
+       enet_protocol_negotiate_features (host, peer, extension);
+
+       verifyExtension = enet_protocol_create_extension (host, peer -> protocolFeatures);
+    }
+
+    if (enet_peer_queue_outgoing_command (peer, & verifyCommand, verifyExtension, 0, verifyExtension != NULL ? verifyExtension -> dataLength : 0) == NULL &&
+        verifyExtension != NULL)
+      enet_packet_destroy (verifyExtension);
 
     return peer;
 }
@@ -424,6 +896,7 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
 static int
 enet_protocol_handle_send_reliable (ENetHost * host, ENetPeer * peer, const ENetProtocol * command, enet_uint8 ** currentData)
 {
+    const enet_uint8 * data;
     size_t dataLength;
 
     if (command -> header.channelID >= peer -> channelCount ||
@@ -431,13 +904,14 @@ enet_protocol_handle_send_reliable (ENetHost * host, ENetPeer * peer, const ENet
       return -1;
 
     dataLength = ENET_NET_TO_HOST_16 (command -> sendReliable.dataLength);
+    data = * currentData;
     * currentData += dataLength;
     if (dataLength > host -> maximumPacketSize ||
         * currentData < host -> receivedData ||
         * currentData > & host -> receivedData [host -> receivedDataLength])
       return -1;
 
-    if (enet_peer_queue_incoming_command (peer, command, (const enet_uint8 *) command + sizeof (ENetProtocolSendReliable), dataLength, ENET_PACKET_FLAG_RELIABLE, 0) == NULL)
+    if (enet_peer_queue_incoming_command (peer, command, data, dataLength, ENET_PACKET_FLAG_RELIABLE, 0) == NULL)
       return -1;
 
     return 0;
@@ -447,6 +921,7 @@ static int
 enet_protocol_handle_send_unsequenced (ENetHost * host, ENetPeer * peer, const ENetProtocol * command, enet_uint8 ** currentData)
 {
     enet_uint32 unsequencedGroup, index;
+    const enet_uint8 * data;
     size_t dataLength;
 
     if (command -> header.channelID >= peer -> channelCount ||
@@ -454,6 +929,7 @@ enet_protocol_handle_send_unsequenced (ENetHost * host, ENetPeer * peer, const E
       return -1;
 
     dataLength = ENET_NET_TO_HOST_16 (command -> sendUnsequenced.dataLength);
+    data = * currentData;
     * currentData += dataLength;
     if (dataLength > host -> maximumPacketSize ||
         * currentData < host -> receivedData ||
@@ -481,7 +957,7 @@ enet_protocol_handle_send_unsequenced (ENetHost * host, ENetPeer * peer, const E
     if (peer -> unsequencedWindow [index / 32] & (1 << (index % 32)))
       return 0;
 
-    if (enet_peer_queue_incoming_command (peer, command, (const enet_uint8 *) command + sizeof (ENetProtocolSendUnsequenced), dataLength, ENET_PACKET_FLAG_UNSEQUENCED, 0) == NULL)
+    if (enet_peer_queue_incoming_command (peer, command, data, dataLength, ENET_PACKET_FLAG_UNSEQUENCED, 0) == NULL)
       return -1;
 
     peer -> unsequencedWindow [index / 32] |= 1 << (index % 32);
@@ -492,6 +968,7 @@ enet_protocol_handle_send_unsequenced (ENetHost * host, ENetPeer * peer, const E
 static int
 enet_protocol_handle_send_unreliable (ENetHost * host, ENetPeer * peer, const ENetProtocol * command, enet_uint8 ** currentData)
 {
+    const enet_uint8 * data;
     size_t dataLength;
 
     if (command -> header.channelID >= peer -> channelCount ||
@@ -499,13 +976,14 @@ enet_protocol_handle_send_unreliable (ENetHost * host, ENetPeer * peer, const EN
       return -1;
 
     dataLength = ENET_NET_TO_HOST_16 (command -> sendUnreliable.dataLength);
+    data = * currentData;
     * currentData += dataLength;
     if (dataLength > host -> maximumPacketSize ||
         * currentData < host -> receivedData ||
         * currentData > & host -> receivedData [host -> receivedDataLength])
       return -1;
 
-    if (enet_peer_queue_incoming_command (peer, command, (const enet_uint8 *) command + sizeof (ENetProtocolSendUnreliable), dataLength, 0, 0) == NULL)
+    if (enet_peer_queue_incoming_command (peer, command, data, dataLength, 0, 0) == NULL)
       return -1;
 
     return 0;
@@ -520,16 +998,17 @@ enet_protocol_handle_send_fragment (ENetHost * host, ENetPeer * peer, const ENet
            fragmentLength,
            startSequenceNumber,
            totalLength;
+    const enet_uint8 * data;
     ENetChannel * channel;
     enet_uint16 startWindow, currentWindow;
-    ENetListIterator currentCommand;
-    ENetIncomingCommand * startCommand = NULL;
+    ENetIncomingCommand * startCommand;
 
     if (command -> header.channelID >= peer -> channelCount ||
         (peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER))
       return -1;
 
     fragmentLength = ENET_NET_TO_HOST_16 (command -> sendFragment.dataLength);
+    data = * currentData;
     * currentData += fragmentLength;
     if (fragmentLength > host -> maximumPacketSize ||
         * currentData < host -> receivedData ||
@@ -559,35 +1038,12 @@ enet_protocol_handle_send_fragment (ENetHost * host, ENetPeer * peer, const ENet
         fragmentLength > totalLength - fragmentOffset)
       return -1;
 
-    for (currentCommand = enet_list_previous (enet_list_end (& channel -> incomingReliableCommands));
-         currentCommand != enet_list_end (& channel -> incomingReliableCommands);
-         currentCommand = enet_list_previous (currentCommand))
-    {
-       ENetIncomingCommand * incomingCommand = (ENetIncomingCommand *) currentCommand;
-
-       if (startSequenceNumber >= channel -> incomingReliableSequenceNumber)
-       {
-          if (incomingCommand -> reliableSequenceNumber < channel -> incomingReliableSequenceNumber)
-            continue;
-       }
-       else
-       if (incomingCommand -> reliableSequenceNumber >= channel -> incomingReliableSequenceNumber)
-         break;
-
-       if (incomingCommand -> reliableSequenceNumber <= startSequenceNumber)
-       {
-          if (incomingCommand -> reliableSequenceNumber < startSequenceNumber)
-            break;
-
-          if ((incomingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) != ENET_PROTOCOL_COMMAND_SEND_FRAGMENT ||
-              totalLength != incomingCommand -> packet -> dataLength ||
-              fragmentCount != incomingCommand -> fragmentCount)
-            return -1;
-
-          startCommand = incomingCommand;
-          break;
-       }
-    }
+    startCommand = enet_peer_find_incoming_reliable_command (channel, startSequenceNumber);
+    if (startCommand != NULL &&
+        ((startCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) != ENET_PROTOCOL_COMMAND_SEND_FRAGMENT ||
+         totalLength != startCommand -> packet -> dataLength ||
+         fragmentCount != startCommand -> fragmentCount))
+      return -1;
 
     if (startCommand == NULL)
     {
@@ -610,11 +1066,20 @@ enet_protocol_handle_send_fragment (ENetHost * host, ENetPeer * peer, const ENet
          fragmentLength = startCommand -> packet -> dataLength - fragmentOffset;
 
        memcpy (startCommand -> packet -> data + fragmentOffset,
-               (enet_uint8 *) command + sizeof (ENetProtocolSendFragment),
+               data,
                fragmentLength);
 
         if (startCommand -> fragmentsRemaining <= 0)
-          enet_peer_dispatch_incoming_reliable_commands (peer, channel);
+        {
+          ENET_PROBE5 (fragment__reassemble, peer, command -> header.channelID, startSequenceNumber, fragmentCount, totalLength);
+
+          enet_peer_dispatch_incoming_reliable_commands (peer, channel, NULL);
+        }
+    }
+    else
+    {
+       ++ peer -> stats.duplicateCommands;
+       ++ host -> stats.duplicateCommands;
     }
 
     return 0;
@@ -630,6 +1095,7 @@ enet_protocol_handle_send_unreliable_fragment (ENetHost * host, ENetPeer * peer,
            reliableSequenceNumber,
            startSequenceNumber,
            totalLength;
+    const enet_uint8 * data;
     enet_uint16 reliableWindow, currentWindow;
     ENetChannel * channel;
     ENetListIterator currentCommand;
@@ -640,6 +1106,7 @@ enet_protocol_handle_send_unreliable_fragment (ENetHost * host, ENetPeer * peer,
       return -1;
 
     fragmentLength = ENET_NET_TO_HOST_16 (command -> sendFragment.dataLength);
+    data = * currentData;
     * currentData += fragmentLength;
     if (fragmentLength > host -> maximumPacketSize ||
         * currentData < host -> receivedData ||
@@ -728,11 +1195,20 @@ enet_protocol_handle_send_unreliable_fragment (ENetHost * host, ENetPeer * peer,
          fragmentLength = startCommand -> packet -> dataLength - fragmentOffset;
 
        memcpy (startCommand -> packet -> data + fragmentOffset,
-               (enet_uint8 *) command + sizeof (ENetProtocolSendFragment),
+               data,
                fragmentLength);
 
         if (startCommand -> fragmentsRemaining <= 0)
+        {
+          ENET_PROBE5 (fragment__reassemble, peer, command -> header.channelID, startSequenceNumber, fragmentCount, totalLength);
+
           enet_peer_dispatch_incoming_unreliable_commands (peer, channel);
+        }
+    }
+    else
+    {
+       ++ peer -> stats.duplicateCommands;
+       ++ host -> stats.duplicateCommands;
     }
 
     return 0;
@@ -882,6 +1358,8 @@ enet_protocol_handle_acknowledge (ENetHost * host, ENetEvent * event, ENetPeer *
 
     commandNumber = enet_protocol_remove_sent_reliable_command (peer, receivedReliableSequenceNumber, command -> header.channelID);
 
+    ENET_PROBE5 (command__acknowledge, peer, commandNumber, command -> header.channelID, receivedReliableSequenceNumber, roundTripTime);
+
     switch (peer -> state)
     {
     case ENET_PEER_STATE_ACKNOWLEDGING_CONNECT:
@@ -899,9 +1377,7 @@ enet_protocol_handle_acknowledge (ENetHost * host, ENetEvent * event, ENetPeer *
        break;
 
     case ENET_PEER_STATE_DISCONNECT_LATER:
-       if (enet_list_empty (& peer -> outgoingReliableCommands) &&
-           enet_list_empty (& peer -> outgoingUnreliableCommands) &&
-           enet_list_empty (& peer -> sentReliableCommands))
+       if (! enet_peer_has_outgoing_commands (peer))
          enet_peer_disconnect (peer, peer -> eventData);
        break;
 
@@ -913,7 +1389,7 @@ enet_protocol_handle_acknowledge (ENetHost * host, ENetEvent * event, ENetPeer *
 }
 
 static int
-enet_protocol_handle_verify_connect (ENetHost * host, ENetEvent * event, ENetPeer * peer, const ENetProtocol * command)
+enet_protocol_handle_verify_connect (ENetHost * host, ENetEvent * event, ENetPeer * peer, const ENetProtocol * command, const ENetProtocolExtension * extension)
 {
     enet_uint32 mtu, windowSize;
     size_t channelCount;
@@ -970,6 +1446,9 @@ enet_protocol_handle_verify_connect (ENetHost * host, ENetEvent * event, ENetPee
     peer -> incomingBandwidth = ENET_NET_TO_HOST_32 (command -> verifyConnect.incomingBandwidth);
     peer -> outgoingBandwidth = ENET_NET_TO_HOST_32 (command -> verifyConnect.outgoingBandwidth);
 
+    if (extension != NULL)
+      enet_protocol_negotiate_features (host, peer, extension);
+
     enet_protocol_notify_connect (host, peer, event);
     return 0;
 }
@@ -978,12 +1457,16 @@ static int
 enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
 {
     ENetProtocolHeader * header;
-    ENetProtocol * command;
+    ENetProtocol * command, compactCommand;
+    ENetProtocolCommandHeader previousCommand;
+    ENetProtocolExtension extension;
     ENetPeer * peer;
     enet_uint8 * currentData;
-    size_t headerSize;
+    size_t headerSize, receivedLength = host -> receivedDataLength;
     enet_uint16 peerID, flags;
     enet_uint8 sessionID;
+    enet_uint64 profileStart;
+    int compact = 0;
 
     if (host -> receivedDataLength < (size_t) & ((ENetProtocolHeader *) 0) -> sentTime)
       return 0;
@@ -1019,15 +1502,18 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
 
     if (flags & ENET_PROTOCOL_HEADER_FLAG_COMPRESSED)
     {
+        ENetCompressor * compressor = enet_protocol_peer_compressor (host, peer);
         size_t originalSize;
-        if (host -> compressor.context == NULL || host -> compressor.decompress == NULL)
+        if (compressor -> context == NULL || compressor -> decompress == NULL)
           return 0;
 
-        originalSize = host -> compressor.decompress (host -> compressor.context,
+        ENET_PROFILE_START (host, profileStart);
+        originalSize = compressor -> decompress (compressor -> context,
                                     host -> receivedData + headerSize,
                                     host -> receivedDataLength - headerSize,
                                     host -> packetData [1] + headerSize,
                                     sizeof (host -> packetData [1]) - headerSize);
+        ENET_PROFILE_STOP (host, ENET_PROFILE_PHASE_COMPRESS, NULL, profileStart);
         if (originalSize <= 0 || originalSize > sizeof (host -> packetData [1]) - headerSize)
           return 0;
 
@@ -1039,7 +1525,8 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
     if (host -> checksum != NULL)
     {
         enet_uint32 * checksum = (enet_uint32 *) & host -> receivedData [headerSize - sizeof (enet_uint32)],
-                    desiredChecksum = * checksum;
+                    desiredChecksum = * checksum,
+                    actualChecksum;
         ENetBuffer buffer;
 
         * checksum = peer != NULL ? peer -> connectID : 0;
@@ -1047,14 +1534,26 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
         buffer.data = host -> receivedData;
         buffer.dataLength = host -> receivedDataLength;
 
-        if (host -> checksum (& buffer, 1) != desiredChecksum)
-          return 0;
+        ENET_PROFILE_START (host, profileStart);
+        actualChecksum = host -> checksum (& buffer, 1);
+        ENET_PROFILE_STOP (host, ENET_PROFILE_PHASE_CHECKSUM, NULL, profileStart);
+
+        if (actualChecksum != desiredChecksum)
+        {
+            ++ host -> stats.checksumFailures;
+            if (peer != NULL)
+              ++ peer -> stats.checksumFailures;
+
+            return 0;
+        }
     }
 
     if (peer != NULL)
     {
        peer -> address.port       = host -> receivedAddress.port;
        peer -> incomingDataTotal += host -> receivedDataLength;
+       peer -> stats.receivedData += receivedLength;
+       ++ peer -> stats.receivedDatagrams;
 
        switch (peer -> address.family)
        {
@@ -1073,29 +1572,61 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
 
     currentData = host -> receivedData + headerSize;
 
+    memset (& previousCommand, 0, sizeof (ENetProtocolCommandHeader));
+
+    if (currentData < & host -> receivedData [host -> receivedDataLength] &&
+        * currentData == ENET_PROTOCOL_COMMAND_COMPACT)
+    {
+       if (peer == NULL ||
+           ! ((peer -> protocolFeatures | host -> protocolFeatures) & ENET_PROTOCOL_FEATURE_COMPACT_COMMANDS))
+         return 0;
+
+       compact = 1;
+       previousCommand.channelID = 0xFF;
+
+       ++ currentData;
+    }
+
     while (currentData < & host -> receivedData [host -> receivedDataLength])
     {
        enet_uint8 commandNumber;
-       size_t commandSize;
 
-       command = (ENetProtocol *) currentData;
+       if (compact)
+       {
+          command = & compactCommand;
+
+          if (enet_protocol_decode_compact_command (host, & currentData, & previousCommand, command) < 0)
+            break;
+
+          commandNumber = command -> header.command & ENET_PROTOCOL_COMMAND_MASK;
+       }
+       else
+       {
+          size_t commandSize;
+
+          command = (ENetProtocol *) currentData;
 
-       if (currentData + sizeof (ENetProtocolCommandHeader) > & host -> receivedData [host -> receivedDataLength])
-         break;
+          if (currentData + sizeof (ENetProtocolCommandHeader) > & host -> receivedData [host -> receivedDataLength])
+            break;
 
-       commandNumber = command -> header.command & ENET_PROTOCOL_COMMAND_MASK;
-       if (commandNumber >= ENET_PROTOCOL_COMMAND_COUNT)
-         break;
+          commandNumber = command -> header.command & ENET_PROTOCOL_COMMAND_MASK;
+          if (commandNumber >= ENET_PROTOCOL_COMMAND_COUNT)
+            break;
 
-       commandSize = commandSizes [commandNumber];
-       if (commandSize == 0 || currentData + commandSize > & host -> receivedData [host -> receivedDataLength])
-         break;
+          commandSize = commandSizes [commandNumber];
+          if (commandSize == 0 || currentData + commandSize > & host -> receivedData [host -> receivedDataLength])
+            break;
 
-       currentData += commandSize;
+          currentData += commandSize;
+       }
 
        if (peer == NULL && commandNumber != ENET_PROTOCOL_COMMAND_CONNECT)
          break;
 
+       ++ host -> stats.receivedCommands [commandNumber];
+       if (peer != NULL)
+         ++ peer -> stats.receivedCommands [commandNumber];
+
        command -> header.reliableSequenceNumber = ENET_NET_TO_HOST_16 (command -> header.reliableSequenceNumber);
 
        switch (commandNumber)
@@ -1108,13 +1639,15 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
        case ENET_PROTOCOL_COMMAND_CONNECT:
           if (peer != NULL)
             goto commandError;
-          peer = enet_protocol_handle_connect (host, header, command);
+          peer = enet_protocol_handle_connect (host, header, command,
+                    enet_protocol_read_extension (host, & currentData, & extension) ? & extension : NULL);
           if (peer == NULL)
             goto commandError;
           break;
 
        case ENET_PROTOCOL_COMMAND_VERIFY_CONNECT:
-          if (enet_protocol_handle_verify_connect (host, event, peer, command))
+          if (enet_protocol_handle_verify_connect (host, event, peer, command,
+                    enet_protocol_read_extension (host, & currentData, & extension) ? & extension : NULL))
             goto commandError;
           break;
 
@@ -1201,9 +1734,32 @@ commandError:
     if (event != NULL && event -> type != ENET_EVENT_TYPE_NONE)
       return 1;
 
+    if (host -> receiveFailed)
+    {
+       host -> receiveFailed = 0;
+
+       return -1;
+    }
+
     return 0;
 }
 
+#ifdef ENET_PROFILE
+static ENetPeer *
+enet_protocol_received_peer (ENetHost * host)
+{
+    enet_uint16 peerID;
+
+    if (host -> receivedDataLength < sizeof (enet_uint16))
+      return NULL;
+
+    peerID = ENET_NET_TO_HOST_16 (((ENetProtocolHeader *) host -> receivedData) -> peerID);
+    peerID &= ~ (ENET_PROTOCOL_HEADER_FLAG_MASK | ENET_PROTOCOL_HEADER_SESSION_MASK);
+
+    return peerID < host -> peerCount ? & host -> peers [peerID] : NULL;
+}
+#endif
+
 static int
 enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
 {
@@ -1211,16 +1767,27 @@ enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
 
     for (packets = 0; packets < 256; ++ packets)
     {
-       int receivedLength;
+       int receivedLength, result;
        ENetBuffer buffer;
+       enet_uint64 profileStart;
+
+       /* a receive callback failed in a datagram that also produced an event, which was returned first */
+       if (host -> receiveFailed)
+       {
+          host -> receiveFailed = 0;
+
+          return -1;
+       }
 
        buffer.data = host -> packetData [0];
        buffer.dataLength = sizeof (host -> packetData [0]);
 
+       ENET_PROFILE_START (host, profileStart);
        receivedLength = enet_socket_receive (host -> socket,
                                              & host -> receivedAddress,
                                              & buffer,
                                              1);
+       ENET_PROFILE_STOP (host, ENET_PROFILE_PHASE_RECEIVE, NULL, profileStart);
 
        if (receivedLength < 0)
          return -1;
@@ -1233,6 +1800,10 @@ enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
 
        host -> totalReceivedData += receivedLength;
        host -> totalReceivedPackets ++;
+       host -> stats.receivedData += receivedLength;
+       ++ host -> stats.receivedDatagrams;
+
+       ENET_PROBE2 (datagram__receive, host, receivedLength);
 
        if (host -> intercept != NULL)
        {
@@ -1252,7 +1823,11 @@ enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
           }
        }
 
-       switch (enet_protocol_handle_incoming_commands (host, event))
+       ENET_PROFILE_START (host, profileStart);
+       result = enet_protocol_handle_incoming_commands (host, event);
+       ENET_PROFILE_STOP (host, ENET_PROFILE_PHASE_DECODE, enet_protocol_received_peer (host), profileStart);
+
+       switch (result)
        {
        case 1:
           return 1;
@@ -1281,11 +1856,12 @@ enet_protocol_send_acknowledgements (ENetHost * host, ENetPeer * peer)
 
     while (currentAcknowledgement != enet_list_end (& peer -> acknowledgements))
     {
-       if (command >= & host -> commands [sizeof (host -> commands) / sizeof (ENetProtocol)] ||
-           buffer >= & host -> buffers [sizeof (host -> buffers) / sizeof (ENetBuffer)] ||
+       if (command >= & host -> commands [host -> commandLimit] ||
+           buffer >= & host -> buffers [host -> bufferLimit] ||
            peer -> mtu - host -> packetSize < sizeof (ENetProtocolAcknowledge))
        {
-          host -> continueSending = 1;
+          if (command > host -> commands)
+            host -> continueSending = 1;
 
           break;
        }
@@ -1311,7 +1887,7 @@ enet_protocol_send_acknowledgements (ENetHost * host, ENetPeer * peer)
          enet_protocol_dispatch_state (host, peer, ENET_PEER_STATE_ZOMBIE);
 
        enet_list_remove (& acknowledgement -> acknowledgementList);
-       enet_free (acknowledgement);
+       enet_object_pool_free (& host -> acknowledgementPool, acknowledgement);
 
        ++ command;
        ++ buffer;
@@ -1321,30 +1897,101 @@ enet_protocol_send_acknowledgements (ENetHost * host, ENetPeer * peer)
     host -> bufferCount = buffer - host -> buffers;
 }
 
-static void
-enet_protocol_send_unreliable_outgoing_commands (ENetHost * host, ENetPeer * peer)
+enum
+{
+    ENET_PROTOCOL_SEND_IDLE    = 0,
+    ENET_PROTOCOL_SEND_DEFICIT = 1,
+    ENET_PROTOCOL_SEND_FULL    = 2,
+
+    ENET_PROTOCOL_SEND_WINDOW_EXCEEDED = (1 << 0),
+    ENET_PROTOCOL_SEND_NO_PING         = (1 << 1)
+};
+
+/* Drops an unreliable command along with any further fragments of the same packet that follow it
+   in the queue, returning the position of the next command to consider. Unsequenced packets all
+   share the same sequence numbers, so fragments are matched by their packet rather than by those. */
+static ENetListIterator
+enet_protocol_drop_unreliable_commands (ENetHost * host, ENetPeer * peer, ENetList * queue, ENetOutgoingCommand * outgoingCommand)
+{
+    ENetPacket * packet = outgoingCommand -> packet;
+    ENetListIterator currentCommand = enet_list_next (& outgoingCommand -> outgoingCommandList);
+
+    for (;;)
+    {
+       if (outgoingCommand -> slotted)
+         enet_peer_clear_slot (peer, outgoingCommand);
+
+       -- outgoingCommand -> packet -> referenceCount;
+
+       if (outgoingCommand -> packet -> referenceCount == 0)
+         enet_packet_destroy (outgoingCommand -> packet);
+
+       enet_list_remove (& outgoingCommand -> outgoingCommandList);
+       enet_object_pool_free (& host -> outgoingCommandPool, outgoingCommand);
+
+       if (currentCommand == enet_list_end (queue))
+         break;
+
+       outgoingCommand = (ENetOutgoingCommand *) currentCommand;
+       if (outgoingCommand -> packet != packet ||
+           outgoingCommand -> fragmentOffset == 0)
+         break;
+
+       currentCommand = enet_list_next (currentCommand);
+    }
+
+    return currentCommand;
+}
+
+static int
+enet_protocol_send_unreliable_queue (ENetHost * host, ENetPeer * peer, ENetChannel * channel)
 {
     ENetProtocol * command = & host -> commands [host -> commandCount];
     ENetBuffer * buffer = & host -> buffers [host -> bufferCount];
+    ENetList * queue = channel != NULL ? & channel -> outgoingUnreliableCommands : & peer -> outgoingUnreliableCommands;
     ENetOutgoingCommand * outgoingCommand;
     ENetListIterator currentCommand;
+    int result = ENET_PROTOCOL_SEND_IDLE;
 
-    currentCommand = enet_list_begin (& peer -> outgoingUnreliableCommands);
+    currentCommand = enet_list_begin (queue);
 
-    while (currentCommand != enet_list_end (& peer -> outgoingUnreliableCommands))
+    while (currentCommand != enet_list_end (queue))
     {
        size_t commandSize;
 
        outgoingCommand = (ENetOutgoingCommand *) currentCommand;
        commandSize = commandSizes [outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK];
 
-       if (command >= & host -> commands [sizeof (host -> commands) / sizeof (ENetProtocol)] ||
-           buffer + 1 >= & host -> buffers [sizeof (host -> buffers) / sizeof (ENetBuffer)] ||
+       if (outgoingCommand -> packet != NULL &&
+           outgoingCommand -> fragmentOffset == 0 &&
+           (outgoingCommand -> packet -> flags & ENET_PACKET_FLAG_DEADLINE) &&
+           ENET_TIME_GREATER (host -> serviceTime, outgoingCommand -> packet -> deadline))
+       {
+          ++ peer -> packetsExpired;
+
+          currentCommand = enet_protocol_drop_unreliable_commands (host, peer, queue, outgoingCommand);
+
+          continue;
+       }
+
+       if (command >= & host -> commands [host -> commandLimit] ||
+           buffer + (outgoingCommand -> packet != NULL ? enet_packet_gather_count (outgoingCommand -> packet, outgoingCommand -> fragmentOffset, outgoingCommand -> fragmentLength) : 1) >= & host -> buffers [host -> bufferLimit] ||
            peer -> mtu - host -> packetSize < commandSize ||
            (outgoingCommand -> packet != NULL &&
              peer -> mtu - host -> packetSize < commandSize + outgoingCommand -> fragmentLength))
        {
-          host -> continueSending = 1;
+          if (command > host -> commands)
+            host -> continueSending = 1;
+
+          result = ENET_PROTOCOL_SEND_FULL;
+
+          break;
+       }
+
+       if (channel != NULL &&
+           channel -> sendDeficit < commandSize + outgoingCommand -> fragmentLength)
+       {
+          result = ENET_PROTOCOL_SEND_DEFICIT;
 
           break;
        }
@@ -1358,33 +2005,21 @@ enet_protocol_send_unreliable_outgoing_commands (ENetHost * host, ENetPeer * pee
 
           if (peer -> packetThrottleCounter > peer -> packetThrottle)
           {
-             enet_uint16 reliableSequenceNumber = outgoingCommand -> reliableSequenceNumber,
-                         unreliableSequenceNumber = outgoingCommand -> unreliableSequenceNumber;
-             for (;;)
-             {
-                -- outgoingCommand -> packet -> referenceCount;
-
-                if (outgoingCommand -> packet -> referenceCount == 0)
-                  enet_packet_destroy (outgoingCommand -> packet);
+             ++ peer -> stats.throttleDrops;
+             ++ host -> stats.throttleDrops;
 
-                enet_list_remove (& outgoingCommand -> outgoingCommandList);
-                enet_free (outgoingCommand);
-
-                if (currentCommand == enet_list_end (& peer -> outgoingUnreliableCommands))
-                  break;
-
-                outgoingCommand = (ENetOutgoingCommand *) currentCommand;
-                if (outgoingCommand -> reliableSequenceNumber != reliableSequenceNumber ||
-                    outgoingCommand -> unreliableSequenceNumber != unreliableSequenceNumber)
-                  break;
-
-                currentCommand = enet_list_next (currentCommand);
-             }
+             currentCommand = enet_protocol_drop_unreliable_commands (host, peer, queue, outgoingCommand);
 
              continue;
           }
        }
 
+       if (channel != NULL)
+         channel -> sendDeficit -= commandSize + outgoingCommand -> fragmentLength;
+
+       if (outgoingCommand -> slotted)
+         enet_peer_clear_slot (peer, outgoingCommand);
+
        buffer -> data = command;
        buffer -> dataLength = commandSize;
 
@@ -1392,21 +2027,23 @@ enet_protocol_send_unreliable_outgoing_commands (ENetHost * host, ENetPeer * pee
 
        * command = outgoingCommand -> command;
 
+       ENET_PROBE5 (command__send, peer, outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK, outgoingCommand -> command.header.channelID, outgoingCommand -> reliableSequenceNumber, outgoingCommand -> sendAttempts);
+
        enet_list_remove (& outgoingCommand -> outgoingCommandList);
 
        if (outgoingCommand -> packet != NULL)
        {
-          ++ buffer;
+          buffer += enet_packet_gather (outgoingCommand -> packet, outgoingCommand -> fragmentOffset, outgoingCommand -> fragmentLength, buffer + 1);
 
-          buffer -> data = outgoingCommand -> packet -> data + outgoingCommand -> fragmentOffset;
-          buffer -> dataLength = outgoingCommand -> fragmentLength;
+          host -> packetSize += outgoingCommand -> fragmentLength;
 
-          host -> packetSize += buffer -> dataLength;
+          if (outgoingCommand -> packet -> flags & ENET_PACKET_FLAG_NO_COMPRESS)
+            host -> incompressibleSize += outgoingCommand -> fragmentLength;
 
           enet_list_insert (enet_list_end (& peer -> sentUnreliableCommands), outgoingCommand);
        }
        else
-         enet_free (outgoingCommand);
+         enet_object_pool_free (& host -> outgoingCommandPool, outgoingCommand);
 
        ++ command;
        ++ buffer;
@@ -1415,21 +2052,23 @@ enet_protocol_send_unreliable_outgoing_commands (ENetHost * host, ENetPeer * pee
     host -> commandCount = command - host -> commands;
     host -> bufferCount = buffer - host -> buffers;
 
-    if (peer -> state == ENET_PEER_STATE_DISCONNECT_LATER &&
-        enet_list_empty (& peer -> outgoingReliableCommands) &&
-        enet_list_empty (& peer -> outgoingUnreliableCommands) &&
-        enet_list_empty (& peer -> sentReliableCommands))
-      enet_peer_disconnect (peer, peer -> eventData);
+    return result;
 }
 
 static int
 enet_protocol_check_timeouts (ENetHost * host, ENetPeer * peer, ENetEvent * event)
 {
     ENetOutgoingCommand * outgoingCommand;
-    ENetListIterator currentCommand, insertPosition;
+    ENetListIterator currentCommand;
+    ENetList timedOutCommands;
+    enet_uint64 profileStart;
+    int result = 0;
+
+    ENET_PROFILE_START (host, profileStart);
+
+    enet_list_clear (& timedOutCommands);
 
     currentCommand = enet_list_begin (& peer -> sentReliableCommands);
-    insertPosition = enet_list_begin (& peer -> outgoingReliableCommands);
 
     while (currentCommand != enet_list_end (& peer -> sentReliableCommands))
     {
@@ -1449,19 +2088,26 @@ enet_protocol_check_timeouts (ENetHost * host, ENetPeer * peer, ENetEvent * even
                (outgoingCommand -> roundTripTimeout >= outgoingCommand -> roundTripTimeoutLimit &&
                  ENET_TIME_DIFFERENCE (host -> serviceTime, peer -> earliestTimeout) >= peer -> timeoutMinimum)))
        {
-          enet_protocol_notify_disconnect (host, peer, event);
+          ENET_PROBE3 (peer__timeout, peer, outgoingCommand -> reliableSequenceNumber, outgoingCommand -> roundTripTimeout);
 
-          return 1;
+          result = 1;
+
+          break;
        }
 
+       ENET_PROBE5 (command__retransmit, peer, outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK, outgoingCommand -> command.header.channelID, outgoingCommand -> reliableSequenceNumber, outgoingCommand -> roundTripTimeout);
+
        if (outgoingCommand -> packet != NULL)
          peer -> reliableDataInTransit -= outgoingCommand -> fragmentLength;
 
        ++ peer -> packetsLost;
+       ++ peer -> stats.retransmittedCommands;
+       ++ host -> stats.retransmittedCommands;
 
        outgoingCommand -> roundTripTimeout *= 2;
+       outgoingCommand -> inTransit = 0;
 
-       enet_list_insert (insertPosition, enet_list_remove (& outgoingCommand -> outgoingCommandList));
+       enet_list_insert (enet_list_end (& timedOutCommands), enet_list_remove (& outgoingCommand -> outgoingCommandList));
 
        if (currentCommand == enet_list_begin (& peer -> sentReliableCommands) &&
            ! enet_list_empty (& peer -> sentReliableCommands))
@@ -1472,28 +2118,49 @@ enet_protocol_check_timeouts (ENetHost * host, ENetPeer * peer, ENetEvent * even
        }
     }
 
-    return 0;
+    /* resend the timed out commands ahead of everything else queued on their channels, in the order they were first sent */
+    while (! enet_list_empty (& timedOutCommands))
+    {
+       outgoingCommand = (ENetOutgoingCommand *) enet_list_remove (enet_list_previous (enet_list_end (& timedOutCommands)));
+
+       if (outgoingCommand -> command.header.channelID < peer -> channelCount)
+       {
+          ENetChannel * channel = & peer -> channels [outgoingCommand -> command.header.channelID];
+
+          enet_list_insert (enet_list_begin (& channel -> outgoingReliableCommands), outgoingCommand);
+
+          enet_peer_queue_channel (peer, channel);
+       }
+       else
+         enet_list_insert (enet_list_begin (& peer -> outgoingReliableCommands), outgoingCommand);
+    }
+
+    ENET_PROFILE_STOP (host, ENET_PROFILE_PHASE_TIMEOUTS, NULL, profileStart);
+
+    if (result)
+      enet_protocol_notify_disconnect (host, peer, event);
+
+    return result;
 }
 
 static int
-enet_protocol_send_reliable_outgoing_commands (ENetHost * host, ENetPeer * peer)
+enet_protocol_send_reliable_queue (ENetHost * host, ENetPeer * peer, ENetChannel * channel, int * state)
 {
     ENetProtocol * command = & host -> commands [host -> commandCount];
     ENetBuffer * buffer = & host -> buffers [host -> bufferCount];
+    ENetList * queue = channel != NULL ? & channel -> outgoingReliableCommands : & peer -> outgoingReliableCommands;
     ENetOutgoingCommand * outgoingCommand;
     ENetListIterator currentCommand;
-    ENetChannel *channel;
     enet_uint16 reliableWindow;
     size_t commandSize;
-    int windowExceeded = 0, windowWrap = 0, canPing = 1;
+    int windowWrap = 0, result = ENET_PROTOCOL_SEND_IDLE;
 
-    currentCommand = enet_list_begin (& peer -> outgoingReliableCommands);
+    currentCommand = enet_list_begin (queue);
 
-    while (currentCommand != enet_list_end (& peer -> outgoingReliableCommands))
+    while (currentCommand != enet_list_end (queue))
     {
        outgoingCommand = (ENetOutgoingCommand *) currentCommand;
 
-       channel = outgoingCommand -> command.header.channelID < peer -> channelCount ? & peer -> channels [outgoingCommand -> command.header.channelID] : NULL;
        reliableWindow = outgoingCommand -> reliableSequenceNumber / ENET_PEER_RELIABLE_WINDOW_SIZE;
        if (channel != NULL)
        {
@@ -1503,7 +2170,12 @@ enet_protocol_send_reliable_outgoing_commands (ENetHost * host, ENetPeer * peer)
                (channel -> reliableWindows [(reliableWindow + ENET_PEER_RELIABLE_WINDOWS - 1) % ENET_PEER_RELIABLE_WINDOWS] >= ENET_PEER_RELIABLE_WINDOW_SIZE ||
                  channel -> usedReliableWindows & ((((1 << ENET_PEER_FREE_RELIABLE_WINDOWS) - 1) << reliableWindow) |
                    (((1 << ENET_PEER_FREE_RELIABLE_WINDOWS) - 1) >> (ENET_PEER_RELIABLE_WINDOWS - reliableWindow)))))
+          {
              windowWrap = 1;
+
+             ++ peer -> stats.windowStalls;
+             ++ host -> stats.windowStalls;
+          }
           if (windowWrap)
           {
              currentCommand = enet_list_next (currentCommand);
@@ -1514,14 +2186,19 @@ enet_protocol_send_reliable_outgoing_commands (ENetHost * host, ENetPeer * peer)
 
        if (outgoingCommand -> packet != NULL)
        {
-          if (! windowExceeded)
+          if (! (* state & ENET_PROTOCOL_SEND_WINDOW_EXCEEDED))
           {
              enet_uint32 windowSize = (peer -> packetThrottle * peer -> windowSize) / ENET_PEER_PACKET_THROTTLE_SCALE;
 
              if (peer -> reliableDataInTransit + outgoingCommand -> fragmentLength > ENET_MAX (windowSize, peer -> mtu))
-               windowExceeded = 1;
+             {
+                * state |= ENET_PROTOCOL_SEND_WINDOW_EXCEEDED;
+
+                ++ peer -> stats.windowStalls;
+                ++ host -> stats.windowStalls;
+             }
           }
-          if (windowExceeded)
+          if (* state & ENET_PROTOCOL_SEND_WINDOW_EXCEEDED)
           {
              currentCommand = enet_list_next (currentCommand);
 
@@ -1529,28 +2206,64 @@ enet_protocol_send_reliable_outgoing_commands (ENetHost * host, ENetPeer * peer)
           }
        }
 
-       canPing = 0;
+       * state |= ENET_PROTOCOL_SEND_NO_PING;
 
        commandSize = commandSizes [outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK];
-       if (command >= & host -> commands [sizeof (host -> commands) / sizeof (ENetProtocol)] ||
-           buffer + 1 >= & host -> buffers [sizeof (host -> buffers) / sizeof (ENetBuffer)] ||
+       if (command >= & host -> commands [host -> commandLimit] ||
+           buffer + (outgoingCommand -> packet != NULL ? enet_packet_gather_count (outgoingCommand -> packet, outgoingCommand -> fragmentOffset, outgoingCommand -> fragmentLength) : 1) >= & host -> buffers [host -> bufferLimit] ||
            peer -> mtu - host -> packetSize < commandSize ||
            (outgoingCommand -> packet != NULL &&
              (enet_uint16) (peer -> mtu - host -> packetSize) < (enet_uint16) (commandSize + outgoingCommand -> fragmentLength)))
        {
-          host -> continueSending = 1;
+          if (command > host -> commands)
+            host -> continueSending = 1;
+
+          result = ENET_PROTOCOL_SEND_FULL;
 
           break;
        }
 
-       currentCommand = enet_list_next (currentCommand);
+       if (channel != NULL &&
+           channel -> sendDeficit < commandSize + outgoingCommand -> fragmentLength)
+       {
+          result = ENET_PROTOCOL_SEND_DEFICIT;
 
-       if (channel != NULL && outgoingCommand -> sendAttempts < 1)
+          break;
+       }
+
+       if (outgoingCommand -> fragmentsRemaining > 1)
+       {
+          outgoingCommand = enet_peer_split_outgoing_fragment (peer, outgoingCommand);
+          if (outgoingCommand == NULL)
+            break;
+
+          currentCommand = & outgoingCommand -> outgoingCommandList;
+       }
+
+       if (outgoingCommand -> sendAttempts < 1)
        {
-          channel -> usedReliableWindows |= 1 << reliableWindow;
-          ++ channel -> reliableWindows [reliableWindow];
+          ENetSequenceTable ** sentReliableTable = enet_protocol_sent_reliable_table (peer, outgoingCommand -> command.header.channelID);
+
+          if (enet_sequence_table_reserve (sentReliableTable, outgoingCommand -> reliableSequenceNumber) < 0)
+            break;
+
+          enet_sequence_table_insert (* sentReliableTable, outgoingCommand -> reliableSequenceNumber, outgoingCommand);
+
+          if (outgoingCommand -> slotted)
+            enet_peer_clear_slot (peer, outgoingCommand);
+
+          if (channel != NULL)
+          {
+             channel -> usedReliableWindows |= 1 << reliableWindow;
+             ++ channel -> reliableWindows [reliableWindow];
+          }
        }
 
+       if (channel != NULL)
+         channel -> sendDeficit -= commandSize + outgoingCommand -> fragmentLength;
+
+       currentCommand = enet_list_next (currentCommand);
+
        ++ outgoingCommand -> sendAttempts;
 
        if (outgoingCommand -> roundTripTimeout == 0)
@@ -1566,6 +2279,7 @@ enet_protocol_send_reliable_outgoing_commands (ENetHost * host, ENetPeer * peer)
                          enet_list_remove (& outgoingCommand -> outgoingCommandList));
 
        outgoingCommand -> sentTime = host -> serviceTime;
+       outgoingCommand -> inTransit = 1;
 
        buffer -> data = command;
        buffer -> dataLength = commandSize;
@@ -1575,15 +2289,17 @@ enet_protocol_send_reliable_outgoing_commands (ENetHost * host, ENetPeer * peer)
 
        * command = outgoingCommand -> command;
 
+       ENET_PROBE5 (command__send, peer, outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK, outgoingCommand -> command.header.channelID, outgoingCommand -> reliableSequenceNumber, outgoingCommand -> sendAttempts);
+
        if (outgoingCommand -> packet != NULL)
        {
-          ++ buffer;
-
-          buffer -> data = outgoingCommand -> packet -> data + outgoingCommand -> fragmentOffset;
-          buffer -> dataLength = outgoingCommand -> fragmentLength;
+          buffer += enet_packet_gather (outgoingCommand -> packet, outgoingCommand -> fragmentOffset, outgoingCommand -> fragmentLength, buffer + 1);
 
           host -> packetSize += outgoingCommand -> fragmentLength;
 
+          if (outgoingCommand -> packet -> flags & ENET_PACKET_FLAG_NO_COMPRESS)
+            host -> incompressibleSize += outgoingCommand -> fragmentLength;
+
           peer -> reliableDataInTransit += outgoingCommand -> fragmentLength;
        }
 
@@ -1596,7 +2312,215 @@ enet_protocol_send_reliable_outgoing_commands (ENetHost * host, ENetPeer * peer)
     host -> commandCount = command - host -> commands;
     host -> bufferCount = buffer - host -> buffers;
 
-    return canPing;
+    return result;
+}
+
+/* Sends from the queues of the channels of a peer, strictly by priority class and in deficit
+   round robin order within a class. A channel whose next command does not fit in what is left
+   of its turn goes to the back of its class with another turn's worth of bytes, while a channel
+   with nothing it may send right now, such as one waiting for its reliable window, is skipped
+   until every channel of the class is in that state. Sends from the reliable queues, carrying state
+   across them, or from the unreliable queues if state is NULL. Returns 1 once the datagram is full. */
+static int
+enet_protocol_send_channels (ENetHost * host, ENetPeer * peer, int * state)
+{
+    size_t priority;
+
+    for (priority = 0; priority < ENET_PEER_CHANNEL_PRIORITIES; ++ priority)
+    {
+       ENetList * sendQueues = & peer -> sendQueues [priority];
+       size_t waitingChannels = enet_list_size (sendQueues),
+              stalledChannels = 0;
+
+       while (stalledChannels < waitingChannels)
+       {
+          ENetChannel * channel = (ENetChannel *) enet_list_front (sendQueues);
+          size_t commandCount = host -> commandCount;
+          int result;
+
+          if (enet_list_empty (& channel -> outgoingReliableCommands) &&
+              enet_list_empty (& channel -> outgoingUnreliableCommands))
+          {
+             enet_list_remove (& channel -> sendList);
+
+             channel -> needsSend = 0;
+             channel -> sendDeficit = 0;
+
+             -- waitingChannels;
+
+             continue;
+          }
+
+          if (state != NULL)
+            result = enet_protocol_send_reliable_queue (host, peer, channel, state);
+          else
+            result = enet_protocol_send_unreliable_queue (host, peer, channel);
+          if (result == ENET_PROTOCOL_SEND_FULL)
+            return 1;
+
+          enet_list_insert (enet_list_end (sendQueues), enet_list_remove (& channel -> sendList));
+
+          if (result == ENET_PROTOCOL_SEND_DEFICIT)
+          {
+             channel -> sendDeficit += channel -> sendWeight * peer -> mtu;
+
+             stalledChannels = 0;
+          }
+          else
+          if (host -> commandCount != commandCount)
+            stalledChannels = 0;
+          else
+            ++ stalledChannels;
+       }
+    }
+
+    return 0;
+}
+
+static void
+enet_protocol_send_unreliable_outgoing_commands (ENetHost * host, ENetPeer * peer)
+{
+    if (enet_protocol_send_unreliable_queue (host, peer, NULL) != ENET_PROTOCOL_SEND_FULL)
+      enet_protocol_send_channels (host, peer, NULL);
+
+    if (peer -> state == ENET_PEER_STATE_DISCONNECT_LATER &&
+        ! enet_peer_has_outgoing_commands (peer))
+      enet_peer_disconnect (peer, peer -> eventData);
+}
+
+static int
+enet_protocol_send_reliable_outgoing_commands (ENetHost * host, ENetPeer * peer)
+{
+    int state = 0;
+
+    if (enet_protocol_send_reliable_queue (host, peer, NULL, & state) != ENET_PROTOCOL_SEND_FULL)
+      enet_protocol_send_channels (host, peer, & state);
+
+    return ! (state & ENET_PROTOCOL_SEND_NO_PING);
+}
+
+static enet_uint32
+enet_protocol_log2 (enet_uint32 value)
+{
+    enet_uint32 bits = 0;
+
+    while (value >> (bits + 1))
+      ++ bits;
+
+    /* integer part in the high bits, linear approximation of the fraction in the low 8 bits */
+    return (bits << 8) + (((value << 8) >> bits) & 0xFF);
+}
+
+/* Estimates the entropy of the datagram payload in 1/256 bits per byte from a strided sample. */
+static enet_uint32
+enet_protocol_estimate_entropy (const ENetBuffer * buffers, size_t bufferCount, size_t length)
+{
+    enet_uint32 histogram [256], sampleCount = 0, symbol;
+    size_t stride = length > ENET_HOST_COMPRESSION_SAMPLE_MAXIMUM ? length / ENET_HOST_COMPRESSION_SAMPLE_MAXIMUM : 1,
+           position = 0;
+    enet_uint32 sum = 0;
+
+    memset (histogram, 0, sizeof (histogram));
+
+    for (; bufferCount > 0; -- bufferCount, ++ buffers)
+    {
+       const enet_uint8 * data = (const enet_uint8 *) buffers -> data;
+
+       for (; position < buffers -> dataLength; position += stride)
+       {
+          ++ histogram [data [position]];
+          ++ sampleCount;
+       }
+
+       position -= buffers -> dataLength;
+    }
+
+    if (sampleCount == 0)
+      return 0;
+
+    for (symbol = 0; symbol < 256; ++ symbol)
+    {
+       if (histogram [symbol] > 1)
+         sum += histogram [symbol] * enet_protocol_log2 (histogram [symbol]);
+    }
+
+    return enet_protocol_log2 (sampleCount) - sum / sampleCount;
+}
+
+static int
+enet_protocol_should_compress (ENetHost * host, ENetPeer * peer)
+{
+    size_t originalSize = host -> packetSize - sizeof (ENetProtocolHeader);
+
+    if (host -> incompressibleSize * 2 >= originalSize)
+    {
+       ++ host -> totalCompressionSkippedByFlag;
+
+       return 0;
+    }
+
+    if (! host -> adaptiveCompression)
+      return 1;
+
+    if (peer -> compressionSkip > 0)
+    {
+       -- peer -> compressionSkip;
+
+       ++ host -> totalCompressionSkippedByRatio;
+
+       return 0;
+    }
+
+    if (originalSize >= ENET_HOST_COMPRESSION_SAMPLE_MINIMUM &&
+        enet_protocol_estimate_entropy (& host -> buffers [1], host -> bufferCount - 1, originalSize) >= ENET_HOST_COMPRESSION_ENTROPY_LIMIT)
+    {
+       ++ host -> totalCompressionSkippedByEntropy;
+
+       return 0;
+    }
+
+    return 1;
+}
+
+static void
+enet_protocol_update_compression_ratio (ENetPeer * peer, size_t originalSize, size_t compressedSize)
+{
+    enet_uint32 ratio = (enet_uint32) (compressedSize * ENET_PEER_COMPRESSION_RATIO_SCALE / originalSize);
+
+    if (ratio >= peer -> compressionRatio)
+      peer -> compressionRatio += (ratio - peer -> compressionRatio) / 8;
+    else
+      peer -> compressionRatio -= (peer -> compressionRatio - ratio) / 8;
+
+    if (peer -> compressionRatio < ENET_PEER_COMPRESSION_RATIO_LIMIT)
+    {
+       peer -> compressionBackoff = 0;
+
+       return;
+    }
+
+    /* compression is not paying off, so stop trying for a while and back off further each time it still does not */
+    if (peer -> compressionBackoff < ENET_PEER_COMPRESSION_BACKOFF_MINIMUM)
+      peer -> compressionBackoff = ENET_PEER_COMPRESSION_BACKOFF_MINIMUM;
+    else
+    if (peer -> compressionBackoff < ENET_PEER_COMPRESSION_BACKOFF_MAXIMUM)
+      peer -> compressionBackoff *= 2;
+
+    peer -> compressionSkip = peer -> compressionBackoff;
+}
+
+static void
+enet_protocol_count_sent_commands (ENetHost * host, ENetPeer * peer)
+{
+    const ENetProtocol * command;
+
+    for (command = host -> commands; command < & host -> commands [host -> commandCount]; ++ command)
+    {
+       enet_uint8 commandNumber = command -> header.command & ENET_PROTOCOL_COMMAND_MASK;
+
+       ++ host -> stats.sentCommands [commandNumber];
+       ++ peer -> stats.sentCommands [commandNumber];
+    }
 }
 
 static int
@@ -1605,8 +2529,10 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
     enet_uint8 headerData [sizeof (ENetProtocolHeader) + sizeof (enet_uint32)];
     ENetProtocolHeader * header = (ENetProtocolHeader *) headerData;
     ENetPeer * currentPeer;
+    ENetCompressor * compressor;
     int sentLength;
     size_t shouldCompress = 0;
+    enet_uint64 profileStart;
 
     host -> continueSending = 1;
 
@@ -1624,6 +2550,9 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
         host -> commandCount = 0;
         host -> bufferCount = 1;
         host -> packetSize = sizeof (ENetProtocolHeader);
+        host -> incompressibleSize = 0;
+
+        ENET_PROFILE_START (host, profileStart);
 
         if (! enet_list_empty (& currentPeer -> acknowledgements))
           enet_protocol_send_acknowledgements (host, currentPeer);
@@ -1639,8 +2568,10 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
               continue;
         }
 
-        if ((enet_list_empty (& currentPeer -> outgoingReliableCommands) ||
-              enet_protocol_send_reliable_outgoing_commands (host, currentPeer)) &&
+        if (currentPeer -> coalescedChannels > 0)
+          enet_peer_flush_coalesced_packets (currentPeer, host -> coalesceDelay);
+
+        if (enet_protocol_send_reliable_outgoing_commands (host, currentPeer) &&
             enet_list_empty (& currentPeer -> sentReliableCommands) &&
             ENET_TIME_DIFFERENCE (host -> serviceTime, currentPeer -> lastReceiveTime) >= currentPeer -> pingInterval &&
             currentPeer -> mtu - host -> packetSize >= sizeof (ENetProtocolPing))
@@ -1649,8 +2580,9 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
             enet_protocol_send_reliable_outgoing_commands (host, currentPeer);
         }
 
-        if (! enet_list_empty (& currentPeer -> outgoingUnreliableCommands))
-          enet_protocol_send_unreliable_outgoing_commands (host, currentPeer);
+        enet_protocol_send_unreliable_outgoing_commands (host, currentPeer);
+
+        ENET_PROFILE_STOP (host, ENET_PROFILE_PHASE_PACK, currentPeer, profileStart);
 
         if (host -> commandCount == 0)
           continue;
@@ -1685,6 +2617,11 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
            currentPeer -> packetsLost = 0;
         }
 
+        enet_protocol_count_sent_commands (host, currentPeer);
+
+        if (currentPeer -> protocolFeatures & ENET_PROTOCOL_FEATURE_COMPACT_COMMANDS)
+          enet_protocol_compact_commands (host);
+
         host -> buffers -> data = headerData;
         if (host -> headerFlags & ENET_PROTOCOL_HEADER_FLAG_SENT_TIME)
         {
@@ -1695,23 +2632,41 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
         else
           host -> buffers -> dataLength = (size_t) & ((ENetProtocolHeader *) 0) -> sentTime;
 
+        /* a peer only learns that the dictionary was agreed on from the verify connect
+           command, so nothing is compressed for it until that has been acknowledged */
+        compressor = enet_protocol_peer_compressor (host, currentPeer);
         shouldCompress = 0;
-        if (host -> compressor.context != NULL && host -> compressor.compress != NULL)
+        if (compressor -> context != NULL && compressor -> compress != NULL &&
+            (compressor != & host -> dictionaryCompressor || currentPeer -> state != ENET_PEER_STATE_ACKNOWLEDGING_CONNECT) &&
+            enet_protocol_should_compress (host, currentPeer))
         {
             size_t originalSize = host -> packetSize - sizeof(ENetProtocolHeader),
-                   compressedSize = host -> compressor.compress (host -> compressor.context,
+                   compressedSize;
+
+            ENET_PROFILE_START (host, profileStart);
+            compressedSize = compressor -> compress (compressor -> context,
                                         & host -> buffers [1], host -> bufferCount - 1,
                                         originalSize,
                                         host -> packetData [1],
                                         originalSize);
+            ENET_PROFILE_STOP (host, ENET_PROFILE_PHASE_COMPRESS, currentPeer, profileStart);
+
             if (compressedSize > 0 && compressedSize < originalSize)
             {
                 host -> headerFlags |= ENET_PROTOCOL_HEADER_FLAG_COMPRESSED;
                 shouldCompress = compressedSize;
+                ++ host -> totalCompressedPackets;
+                host -> stats.compressionSavings += originalSize - compressedSize;
+                currentPeer -> stats.compressionSavings += originalSize - compressedSize;
 #ifdef ENET_DEBUG_COMPRESS
                 printf ("peer %u: compressed %u -> %u (%u%%)\n", currentPeer -> incomingPeerID, originalSize, compressedSize, (compressedSize * 100) / originalSize);
 #endif
             }
+            else
+              ++ host -> totalCompressionFailures;
+
+            if (host -> adaptiveCompression)
+              enet_protocol_update_compression_ratio (currentPeer, originalSize, shouldCompress > 0 ? shouldCompress : originalSize);
         }
 
         if (currentPeer -> outgoingPeerID < ENET_PROTOCOL_MAXIMUM_PEER_ID)
@@ -1722,7 +2677,9 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
             enet_uint32 * checksum = (enet_uint32 *) & headerData [host -> buffers -> dataLength];
             * checksum = currentPeer -> outgoingPeerID < ENET_PROTOCOL_MAXIMUM_PEER_ID ? currentPeer -> connectID : 0;
             host -> buffers -> dataLength += sizeof (enet_uint32);
+            ENET_PROFILE_START (host, profileStart);
             * checksum = host -> checksum (host -> buffers, host -> bufferCount);
+            ENET_PROFILE_STOP (host, ENET_PROFILE_PHASE_CHECKSUM, currentPeer, profileStart);
         }
 
         if (shouldCompress > 0)
@@ -1734,7 +2691,9 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
 
         currentPeer -> lastSendTime = host -> serviceTime;
 
+        ENET_PROFILE_START (host, profileStart);
         sentLength = enet_socket_send (host -> socket, & currentPeer -> address, host -> buffers, host -> bufferCount);
+        ENET_PROFILE_STOP (host, ENET_PROFILE_PHASE_SEND, currentPeer, profileStart);
 
         enet_protocol_remove_sent_unreliable_commands (currentPeer);
 
@@ -1743,6 +2702,12 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
 
         host -> totalSentData += sentLength;
         host -> totalSentPackets ++;
+        host -> stats.sentData += sentLength;
+        ++ host -> stats.sentDatagrams;
+        currentPeer -> stats.sentData += sentLength;
+        ++ currentPeer -> stats.sentDatagrams;
+
+        ENET_PROBE3 (datagram__send, host, currentPeer, sentLength);
     }
 
     return 0;
@@ -1752,13 +2717,24 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
 
     @param host   host to flush
     @remarks this function need only be used in circumstances where one wishes to send queued packets earlier than in a call to enet_host_service().
+    Packets still waiting to be coalesced, see enet_host_coalesce(), are sent as well.
     @ingroup host
 */
 void
 enet_host_flush (ENetHost * host)
 {
+    ENetPeer * currentPeer;
+
     host -> serviceTime = enet_time_get ();
 
+    for (currentPeer = host -> peers;
+         currentPeer < & host -> peers [host -> peerCount];
+         ++ currentPeer)
+    {
+       if (currentPeer -> coalescedChannels > 0)
+         enet_peer_flush_coalesced_packets (currentPeer, 0);
+    }
+
     enet_protocol_send_outgoing_commands (host, NULL, 0);
 }
 
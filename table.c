@@ -0,0 +1,153 @@
+/**
+ @file table.c
+ @brief ENet sequence number indexed table functions
+*/
+#include <string.h>
+#define ENET_BUILDING_LIB 1
+#include "enet/enet.h"
+
+/**
+    @defgroup table ENet sequence number indexed table utility functions
+    @ingroup private
+    @{
+*/
+
+enum
+{
+    ENET_SEQUENCE_TABLE_BLOCK_SIZE = 256,
+    ENET_SEQUENCE_TABLE_BLOCKS     = 0x10000 / ENET_SEQUENCE_TABLE_BLOCK_SIZE
+};
+
+typedef struct _ENetSequenceTableBlock
+{
+    size_t entryCount;
+    void * entries [ENET_SEQUENCE_TABLE_BLOCK_SIZE];
+} ENetSequenceTableBlock;
+
+/* The table covers the whole 16 bit sequence space, so callers must only keep entries whose
+   sequence numbers span less than it. Blocks of slots are allocated as entries are reserved
+   in them and freed again once their last entry is removed. */
+struct _ENetSequenceTable
+{
+    size_t                   entryCount;
+    ENetSequenceTableBlock * blocks [ENET_SEQUENCE_TABLE_BLOCKS];
+};
+
+/** Looks up the entry for a sequence number.
+    @param table table to search, may be NULL
+    @param sequenceNumber sequence number to look up
+    @returns the entry, or NULL if there is none
+*/
+void *
+enet_sequence_table_find (const ENetSequenceTable * table, enet_uint16 sequenceNumber)
+{
+    const ENetSequenceTableBlock * block;
+
+    if (table == NULL)
+      return NULL;
+
+    block = table -> blocks [sequenceNumber / ENET_SEQUENCE_TABLE_BLOCK_SIZE];
+    if (block == NULL)
+      return NULL;
+
+    return block -> entries [sequenceNumber % ENET_SEQUENCE_TABLE_BLOCK_SIZE];
+}
+
+/** Allocates the slot for a sequence number, and the table itself if needed, so that an entry
+    may then be inserted with enet_sequence_table_insert without failing.
+    @param table pointer to the table, which is allocated if NULL
+    @param sequenceNumber sequence number to reserve the slot of
+    @retval 0 on success
+    @retval < 0 on failure
+*/
+int
+enet_sequence_table_reserve (ENetSequenceTable ** table, enet_uint16 sequenceNumber)
+{
+    ENetSequenceTableBlock ** block;
+
+    if (* table == NULL)
+    {
+       * table = (ENetSequenceTable *) enet_malloc (sizeof (ENetSequenceTable));
+       if (* table == NULL)
+         return -1;
+
+       memset (* table, 0, sizeof (ENetSequenceTable));
+    }
+
+    block = & (* table) -> blocks [sequenceNumber / ENET_SEQUENCE_TABLE_BLOCK_SIZE];
+    if (* block == NULL)
+    {
+       * block = (ENetSequenceTableBlock *) enet_malloc (sizeof (ENetSequenceTableBlock));
+       if (* block == NULL)
+         return -1;
+
+       memset (* block, 0, sizeof (ENetSequenceTableBlock));
+    }
+
+    return 0;
+}
+
+/** Stores an entry in a slot previously reserved with enet_sequence_table_reserve.
+    @param table table to insert into
+    @param sequenceNumber sequence number of the entry, which must not already have one
+    @param entry entry to store
+*/
+void
+enet_sequence_table_insert (ENetSequenceTable * table, enet_uint16 sequenceNumber, void * entry)
+{
+    ENetSequenceTableBlock * block = table -> blocks [sequenceNumber / ENET_SEQUENCE_TABLE_BLOCK_SIZE];
+
+    block -> entries [sequenceNumber % ENET_SEQUENCE_TABLE_BLOCK_SIZE] = entry;
+    ++ block -> entryCount;
+    ++ table -> entryCount;
+}
+
+/** Removes the entry for a sequence number, freeing its block of slots if it was the last one in it.
+    @param table table to remove from
+    @param sequenceNumber sequence number of an entry in the table
+*/
+void
+enet_sequence_table_remove (ENetSequenceTable * table, enet_uint16 sequenceNumber)
+{
+    ENetSequenceTableBlock ** block = & table -> blocks [sequenceNumber / ENET_SEQUENCE_TABLE_BLOCK_SIZE];
+
+    (* block) -> entries [sequenceNumber % ENET_SEQUENCE_TABLE_BLOCK_SIZE] = NULL;
+    -- table -> entryCount;
+    if (-- (* block) -> entryCount <= 0)
+    {
+       enet_free (* block);
+
+       * block = NULL;
+    }
+}
+
+/** Returns the number of entries in a table.
+    @param table table to count, may be NULL
+*/
+size_t
+enet_sequence_table_size (const ENetSequenceTable * table)
+{
+    return table != NULL ? table -> entryCount : 0;
+}
+
+/** Releases all memory held by a table. The entries themselves are not touched.
+    @param table table to destroy, may be NULL
+*/
+void
+enet_sequence_table_destroy (ENetSequenceTable * table)
+{
+    size_t block;
+
+    if (table == NULL)
+      return;
+
+    for (block = 0; block < ENET_SEQUENCE_TABLE_BLOCKS; ++ block)
+    {
+       if (table -> blocks [block] != NULL)
+         enet_free (table -> blocks [block]);
+    }
+
+    enet_free (table);
+}
+
+/** @} */